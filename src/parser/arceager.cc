@@ -14,6 +14,10 @@ ArcEager::ArcEager() : TransitionSystem() {
     action_names.push_back("LEFT-" + map.get(i));
     action_names.push_back("RIGHT-" + map.get(i));
   }
+  for (unsigned a = 0; a < n_actions; ++a) {
+    action_classes.push_back(is_shift(a) ? kShift :
+                             (is_reduce(a) ? kReduce : (is_left(a) ? kLeft : kRight)));
+  }
   _INFO << "[parse|arceager] show action names:";
   for (const auto& action_name : action_names) {
     _INFO << "- " << action_name;
@@ -194,13 +198,9 @@ void ArcEager::perform_action(State& state, const unsigned& action) {
   }
 }
 
-bool ArcEager::is_valid_action(const State & state, const unsigned & act) const {
-  return false;
-}
-
-void ArcEager::get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) {
+unsigned ArcEager::get_valid_mask(const State& state) const {
   BOOST_ASSERT_MSG(false, "Unimplemented.");
-  valid_actions.clear();
+  unsigned mask = 0;
   unsigned root_id = state.heads.size() - 1;
   unsigned b = state.buffer.back();
 
@@ -214,31 +214,25 @@ void ArcEager::get_valid_actions(const State& state, std::vector<unsigned>& vali
   if (b < root_id - 1 ||
     (b == root_id - 1 && n_empty_heads == 0) ||
       (b == root_id && state.stack.size() == 1)) {
-    valid_actions.push_back(get_shift_id());
+    mask |= (1 << kShift);
   }
 
   if (state.stack.size() > 1) {
     unsigned s = state.stack.back();
     if (state.heads[s] != Corpus::BAD_HED) {
-      valid_actions.push_back(get_reduce_id());
-    } else {
+      mask |= (1 << kReduce);
+    } else if (b < root_id) {
       // try LeftArc
-      if (b < root_id) {
-        for (unsigned i = 0; i < num_deprels(); ++i) {
-          unsigned act = get_left_id(i);
-        }
-      } else {
-      }
+      mask |= (1 << kLeft);
     }
 
     // try RightArc
     if (b < root_id - 1 || (b == root_id - 1 && n_empty_heads == 1)) {
-      for (unsigned i = 0; i < num_deprels(); ++i) {
-        unsigned act = get_right_id(i);
-      }
+      mask |= (1 << kRight);
     }
   }
-  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
+  BOOST_ASSERT_MSG(mask != 0, "There should be one or more valid action.");
+  return mask;
 }
 
 unsigned ArcEager::parse_label(const unsigned& action) {
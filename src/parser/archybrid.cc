@@ -15,6 +15,9 @@ ArcHybrid::ArcHybrid() {
     action_names.push_back("LEFT-" + map.get(i));
     action_names.push_back("RIGHT-" + map.get(i));
   }
+  for (unsigned a = 0; a < n_actions; ++a) {
+    action_classes.push_back(is_shift(a) ? kShift : (is_left(a) ? kLeft : kRight));
+  }
   _INFO << "[parse|archybrid] show action names:";
   for (const auto& action_name : action_names) {
     _INFO << "- " << action_name;
@@ -188,28 +191,17 @@ bool ArcHybrid::is_shift(const unsigned & action) { return action == 0; }
 bool ArcHybrid::is_left(const unsigned & action) { return (action % 2 == 1); }
 bool ArcHybrid::is_right(const unsigned & action) { return (action > 0 && action % 2 == 0); }
 
-bool ArcHybrid::is_valid_action(const State& state, const unsigned& act) const {
-  if (is_shift(act)) {
-    /// guard should not be shifted.
-    if (state.buffer.size() <= 1) { return false; }
-  } else if (is_left(act)) {
+unsigned ArcHybrid::get_valid_mask(const State& state) const {
+  unsigned mask = 0;
+  /// guard should not be shifted.
+  if (state.buffer.size() > 1) { mask |= (1 << kShift); }
+  /// pseduo root should not be reduced.
+  if (state.stack.size() >= 3) {
+    mask |= (1 << kRight);
     /// guard not should not be head.
-    if (state.buffer.size() < 2) { return false; }
-    /// pseduo root should not be reduced.
-    if (state.stack.size() < 3) { return false; }
-  } else {
-    if (state.stack.size() < 3) { return false; }
-  }
-  return true;
-}
-
-void ArcHybrid::get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) {
-  valid_actions.clear();
-  for (unsigned a = 0; a < n_actions; ++a) {
-    if (!is_valid_action(state, a)) { continue; }
-    valid_actions.push_back(a);
+    if (state.buffer.size() >= 2) { mask |= (1 << kLeft); }
   }
-  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
+  return mask;
 }
 
 unsigned ArcHybrid::parse_label(const unsigned& action) {
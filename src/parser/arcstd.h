@@ -33,10 +33,7 @@ struct ArcStandard : public TransitionSystem {
 
   void perform_action(State & state, const unsigned& action) override;
 
-  bool is_valid_action(const State& state, const unsigned& act) const override;
-
-  void get_valid_actions(const State& state,
-                         std::vector<unsigned>& valid_actions) override;
+  unsigned get_valid_mask(const State& state) const override;
 
   void get_oracle_actions(const std::vector<unsigned>& heads,
                           const std::vector<unsigned>& deprels,
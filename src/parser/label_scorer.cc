@@ -0,0 +1,68 @@
+#include "label_scorer.h"
+#include <boost/assert.hpp>
+
+namespace twpipe {
+
+LabelScorer::LabelScorer(dynet::ParameterCollection & m,
+                         const TransitionSystem & system,
+                         unsigned dim_hidden) :
+  left_scorer(m, dim_hidden, system.num_deprels()),
+  right_scorer(m, dim_hidden, system.num_deprels()),
+  class_actions(TransitionSystem::N_ACTION_CLASSES) {
+  const std::vector<unsigned> & classes = system.action_classes;
+  for (unsigned a = 0; a < classes.size(); ++a) {
+    class_actions[classes[a]].push_back(a);
+  }
+
+  unsigned n_deprels = system.num_deprels();
+  BOOST_ASSERT_MSG(class_actions[TransitionSystem::kLeft].size() == n_deprels &&
+                   class_actions[TransitionSystem::kRight].size() == n_deprels,
+                   "[parse|label_scorer] one left and one right action per deprel.");
+  structure_rows = classes;
+  label_rows.assign(classes.size(), 2 * n_deprels);
+  for (unsigned k = 0; k < n_deprels; ++k) {
+    label_rows[class_actions[TransitionSystem::kLeft][k]] = k;
+    label_rows[class_actions[TransitionSystem::kRight][k]] = n_deprels + k;
+  }
+}
+
+void LabelScorer::new_graph(dynet::ComputationGraph & cg) {
+  left_scorer.new_graph(cg);
+  right_scorer.new_graph(cg);
+}
+
+dynet::Expression LabelScorer::get_scores(const dynet::Expression & hidden,
+                                          const dynet::Expression & structure_scores) {
+  dynet::Expression labels = dynet::concatenate({
+    dynet::log_softmax(left_scorer.get_output(hidden)),
+    dynet::log_softmax(right_scorer.get_output(hidden)),
+    dynet::zeroes(*hidden.pg, { 1 })
+  });
+  return (dynet::select_rows(dynet::log_softmax(structure_scores), structure_rows) +
+          dynet::select_rows(labels, label_rows));
+}
+
+unsigned LabelScorer::get_best_action(const dynet::Expression & hidden,
+                                      unsigned action_class) {
+  const std::vector<unsigned> & actions = class_actions[action_class];
+  BOOST_ASSERT_MSG(actions.size() > 0, "[parse|label_scorer] empty action class.");
+  if (action_class != TransitionSystem::kLeft && action_class != TransitionSystem::kRight) {
+    return actions[0];
+  }
+  DenseLayer & scorer = (action_class == TransitionSystem::kLeft ? left_scorer : right_scorer);
+  std::vector<float> scores = dynet::as_vector(hidden.pg->get_value(scorer.get_output(hidden)));
+  unsigned best_k = 0;
+  for (unsigned k = 1; k < scores.size(); ++k) {
+    if (scores[best_k] < scores[k]) { best_k = k; }
+  }
+  return actions[best_k];
+}
+
+std::vector<dynet::Expression> LabelScorer::get_params() {
+  std::vector<dynet::Expression> ret;
+  for (auto & e : left_scorer.get_params()) { ret.push_back(e); }
+  for (auto & e : right_scorer.get_params()) { ret.push_back(e); }
+  return ret;
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef __TWPIPE_PARSER_LABEL_SCORER_H__
+#define __TWPIPE_PARSER_LABEL_SCORER_H__
+
+#include "system.h"
+#include "dynet_layer/layer.h"
+#include <vector>
+
+namespace twpipe {
+
+/**
+ * The second level of the factorized output of the parsers. The scorer of
+ * the model scores the action classes (the structures), and the label of a
+ * left or right arc is scored here by the layer of its direction, so the
+ * labels are only scored for the chosen direction when parsing greedily.
+ */
+struct LabelScorer {
+  DenseLayer left_scorer;
+  DenseLayer right_scorer;
+
+  /// The actions of each class. The k-th action of a left or right class
+  /// carries the k-th deprel, as all the systems add them in that order.
+  std::vector<std::vector<unsigned>> class_actions;
+  /// For each action, its class and its row in [left; right; 0].
+  std::vector<unsigned> structure_rows;
+  std::vector<unsigned> label_rows;
+
+  LabelScorer(dynet::ParameterCollection & m,
+              const TransitionSystem & system,
+              unsigned dim_hidden);
+
+  void new_graph(dynet::ComputationGraph & cg);
+
+  /// The log-probabilities of all the actions, log p(class) + log p(label | class),
+  /// from the hidden layer and the scores of the classes.
+  dynet::Expression get_scores(const dynet::Expression & hidden,
+                               const dynet::Expression & structure_scores);
+
+  /// The action of the best label for the action class.
+  unsigned get_best_action(const dynet::Expression & hidden,
+                           unsigned action_class);
+
+  std::vector<dynet::Expression> get_params();
+};
+
+}
+
+#endif  //  end for __TWPIPE_PARSER_LABEL_SCORER_H__
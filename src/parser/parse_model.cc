@@ -3,8 +3,11 @@
 #include "dynet/expr.h"
 #include "twpipe/logging.h"
 #include "twpipe/alphabet_collection.h"
+#include "twpipe/embedding.h"
+#include "twpipe/elmo.h"
 #include <vector>
 #include <random>
+#include <algorithm>
 
 namespace twpipe {
 
@@ -37,6 +40,10 @@ po::options_description ParseModel::get_options() {
     ("parse-label-dim", po::value<unsigned>()->default_value(20), "The dimension for label.")
     ("parse-lstm-input-dim", po::value<unsigned>()->default_value(100), "The dimension for lstm input.")
     ("parse-hidden-dim", po::value<unsigned>()->default_value(100), "The dimension for hidden unit.")
+    ("parse-beam-size", po::value<unsigned>()->default_value(1), "The beam size, 1 for the greedy search.")
+    ("parse-nbest", po::value<unsigned>()->default_value(1), "The number of trees to output when parsing with beam search.")
+    ("parse-factorized-scorer", po::value<bool>()->default_value(false), "Score the action classes first and then the labels of the chosen arc direction.")
+    ("parse-freeze-size", po::value<unsigned>()->default_value(5000), "The number of vocabulary words whose char encodings are precomputed when testing.")
     ;
   return cmd;
 }
@@ -57,9 +64,84 @@ void ParseModel::initialize_state(const InputUnits & input, State & state) {
   state.stack.push_back(Corpus::BAD_HED);
 }
 
+void ParseModel::get_embeddings(dynet::ComputationGraph & cg,
+                                const InputUnits & input,
+                                std::vector<dynet::Expression> & embeddings) {
+  std::vector<const float *> rows;
+  unsigned len = input.size();
+  // The first unit is pseduo root.
+  if (embedding_type_ == kStaticEmbeddings) {
+    std::vector<std::string> words(len);
+    for (unsigned i = 0; i < len; ++i) { words[i] = input[i].word; }
+    WordEmbedding::get()->render(words, rows);
+    WordEmbedding::input(cg, WordEmbedding::get()->dim(), rows, embeddings);
+  } else {
+    std::vector<std::string> words(len - 1);
+    // It is very tricky here! ELMo doesn't have the _ROOT_ token, so use the zero row.
+    rows.push_back(ELMo::get()->zeros());
+    for (unsigned i = 1; i < len; ++i) { words[i - 1] = input[i].word; }
+    ELMo::get()->render(words, rows);
+    WordEmbedding::input(cg, ELMo::get()->dim(), rows, embeddings);
+  }
+}
+
+dynet::Expression ParseModel::get_char_encoding(const std::vector<unsigned> & cids) {
+  BOOST_ASSERT_MSG(false, "[parse|model] the model doesn't encode characters.");
+  return dynet::Expression();
+}
+
+void ParseModel::get_char_encodings(dynet::ComputationGraph & cg,
+                                    const InputUnits & input,
+                                    std::vector<dynet::Expression> & encodings) {
+  unsigned len = input.size();
+  std::vector<std::string> words(len - 1);
+  for (unsigned i = 1; i < len; ++i) { words[i - 1] = input[i].word; }
+  char_cache.render(cg, get_char_encoding_dim(), words,
+                    [this](const std::vector<unsigned> & cids) { return get_char_encoding(cids); },
+                    encodings);
+}
+
+void ParseModel::freeze(unsigned n_words) {
+  if (get_char_encoding_dim() == 0) { return; }
+  char_cache.freeze(n_words, get_char_encoding_dim(),
+                    [this](dynet::ComputationGraph & cg) { new_graph(cg); },
+                    [this](const std::vector<unsigned> & cids) { return get_char_encoding(cids); });
+}
+
 ParseModel::ParseModel(dynet::ParameterCollection & m,
                        TransitionSystem & s,
-                       EmbeddingType embedding_type) : model(m), sys(s), embedding_type_(embedding_type) {
+                       EmbeddingType embedding_type) :
+  model(m), sys(s), embedding_type_(embedding_type), label_scorer(nullptr) {
+}
+
+dynet::Expression ParseModel::get_scores(StateCheckpoint * checkpoint) {
+  dynet::Expression hidden = get_hidden(checkpoint);
+  dynet::Expression scores = get_scorer_output(hidden);
+  if (label_scorer == nullptr) { return scores; }
+  return label_scorer->get_scores(hidden, scores);
+}
+
+unsigned ParseModel::predict_action(dynet::ComputationGraph & cg,
+                                    StateCheckpoint * checkpoint,
+                                    unsigned valid_mask) {
+  if (label_scorer == nullptr) {
+    std::vector<float> scores = dynet::as_vector(cg.get_value(get_scores(checkpoint)));
+    return sys.get_best_action(scores, valid_mask).first;
+  }
+
+  dynet::Expression hidden = get_hidden(checkpoint);
+  std::vector<float> scores = dynet::as_vector(cg.get_value(get_scorer_output(hidden)));
+  return label_scorer->get_best_action(hidden, get_best_class(scores, valid_mask));
+}
+
+unsigned ParseModel::get_best_class(const std::vector<float> & scores, unsigned valid_mask) {
+  unsigned best_c = UINT_MAX;
+  for (unsigned c = 0; c < scores.size(); ++c) {
+    if (((valid_mask >> c) & 1) == 0) { continue; }
+    if (best_c == UINT_MAX || scores[best_c] < scores[c]) { best_c = c; }
+  }
+  BOOST_ASSERT_MSG(best_c != UINT_MAX, "[parse] there should be one or more valid action class.");
+  return best_c;
 }
 
 void ParseModel::predict(const std::vector<std::string>& words,
@@ -76,6 +158,35 @@ void ParseModel::predict(const std::vector<std::string>& words,
   Corpus::parse_units_to_vector(result, heads, deprels);
 }
 
+void ParseModel::predict(const std::vector<std::string>& words,
+                         const std::vector<std::string>& postags,
+                         unsigned beam_size,
+                         unsigned n_best,
+                         std::vector<std::vector<unsigned>>& heads,
+                         std::vector<std::vector<std::string>>& deprels,
+                         std::vector<float>& scores) {
+  InputUnits input;
+  Corpus::vector_to_input_units(words, postags, input);
+
+  std::vector<ParseUnits> results;
+  dynet::ComputationGraph cg;
+  if (beam_size <= 1) {
+    results.resize(1);
+    predict(cg, input, results[0]);
+    scores.assign(1, 0.f);
+  } else {
+    beam_search(cg, input, beam_size, false, results, &scores);
+  }
+
+  unsigned n = std::min<unsigned>(std::max(n_best, 1u), results.size());
+  heads.resize(n);
+  deprels.resize(n);
+  scores.resize(n);
+  for (unsigned k = 0; k < n; ++k) {
+    Corpus::parse_units_to_vector(results[k], heads[k], deprels[k]);
+  }
+}
+
 void ParseModel::label(const std::vector<std::string> & words,
                        const std::vector<std::string> & postags,
                        const std::vector<unsigned> & heads,
@@ -95,21 +206,13 @@ void ParseModel::predict(dynet::ComputationGraph& cg,
 
   std::vector<unsigned> actions;
   while (!state.terminated()) {
-    // collect all valid actions.
-    std::vector<unsigned> valid_actions;
-    sys.get_valid_actions(state, valid_actions);
-
-    dynet::Expression score_exprs = get_scores(checkpoint);
-    std::vector<float> scores = dynet::as_vector(cg.get_value(score_exprs));
-
-    auto payload = get_best_action(scores, valid_actions);
-    unsigned best_a = payload.first;
+    unsigned best_a = predict_action(cg, checkpoint, sys.get_valid_mask(state));
     actions.push_back(best_a);
     sys.perform_action(state, best_a);
     perform_action(best_a, state, cg, checkpoint);
   }
   destropy_checkpoint(checkpoint);
-  Corpus::vector_to_parse_units(state.heads, state.deprels, parse);
+  state.to_parse_units(parse);
 }
 
 void ParseModel::label(dynet::ComputationGraph & cg,
@@ -129,10 +232,6 @@ void ParseModel::label(dynet::ComputationGraph & cg,
   sys.get_oracle_actions(ref_heads, ref_deprels, ref_actions);
   unsigned step = 0;
   while (!state.terminated()) {
-    // collect all valid actions.
-    std::vector<unsigned> valid_actions;
-    sys.get_valid_actions(state, valid_actions);
-
     dynet::Expression score_exprs = get_scores(checkpoint);
     std::vector<float> scores = dynet::as_vector(cg.get_value(score_exprs));
 
@@ -147,76 +246,89 @@ void ParseModel::label(dynet::ComputationGraph & cg,
     step++;
   }
   destropy_checkpoint(checkpoint);
-  Corpus::vector_to_parse_units(state.heads, state.deprels, output);
+  state.to_parse_units(output);
 }
 
 void ParseModel::beam_search(dynet::ComputationGraph & cg,
                              const InputUnits & input,
                              const unsigned& beam_size,
                              bool structure_score,
-                             std::vector<ParseUnits>& parses) {
+                             std::vector<ParseUnits>& parses,
+                             std::vector<float> * parse_scores) {
+  // (index of the hypothesis in the beam, action, score)
   typedef std::tuple<unsigned, unsigned, float> Transition;
+  struct Hypothesis {
+    State state;
+    float score;
+    StateCheckpoint * checkpoint;
+  };
 
   new_graph(cg);
   unsigned len = input.size();
-  std::vector<State> states;
-  std::vector<float> scores;
-  std::vector<StateCheckpoint*> checkpoints;
-
-  states.push_back(State(len));
-  scores.push_back(0.);
-  StateCheckpoint * initial_checkpoint = get_initial_checkpoint();
-  initialize(cg, input, states[0], initial_checkpoint);
-  checkpoints.push_back(initial_checkpoint);
-
-  unsigned curr = 0, next = 1;
-  while (!states[curr].terminated()) {
-    std::vector<Transition> transitions;
-    for (unsigned i = curr; i < next; ++i) {
-      const State& state = states[i];
-      float score = scores[i];
-      StateCheckpoint * checkpoint = checkpoints[i];
-
-      std::vector<unsigned> valid_actions;
-      sys.get_valid_actions(state, valid_actions);
-
-      dynet::Expression score_exprs = get_scores(checkpoint);
-      if (!structure_score) { score_exprs = dynet::log_softmax(score_exprs); }
-      std::vector<float> s = dynet::as_vector(cg.get_value(score_exprs));
-      for (unsigned a : valid_actions) {
-        transitions.push_back(std::make_tuple(i, a, score + s[a]));
+  std::vector<Hypothesis> beam(1, Hypothesis{ State(len), 0.f, get_initial_checkpoint() });
+  initialize(cg, input, beam[0].state, beam[0].checkpoint);
+
+  std::vector<Hypothesis> next_beam;
+  std::vector<Transition> transitions;
+  std::vector<dynet::Expression> score_exprs;
+  std::vector<unsigned> valid_actions;
+  while (!beam[0].state.terminated()) {
+    if (beam.size() == 1) {
+      // the beam collapsed, a forced action changes no ranking so skip scoring it.
+      sys.get_valid_actions(beam[0].state, valid_actions);
+      if (valid_actions.size() == 1) {
+        sys.perform_action(beam[0].state, valid_actions[0]);
+        perform_action(valid_actions[0], beam[0].state, cg, beam[0].checkpoint);
+        continue;
       }
     }
 
-    sort(transitions.begin(), transitions.end(),
-         [](const Transition& a, const Transition& b) { return std::get<2>(a) > std::get<2>(b); });
-    curr = next;
-
-    for (unsigned i = 0; i < transitions.size() && i < beam_size; ++i) {
-      unsigned cursor = std::get<0>(transitions[i]);
-      unsigned action = std::get<1>(transitions[i]);
-      float new_score = std::get<2>(transitions[i]);
+    // score the whole beam with a single forward.
+    score_exprs.clear();
+    for (const Hypothesis & hyp : beam) {
+      dynet::Expression score_expr = get_scores(hyp.checkpoint);
+      if (!structure_score) { score_expr = dynet::log_softmax(score_expr); }
+      score_exprs.push_back(score_expr);
+    }
+    std::vector<float> s = dynet::as_vector(cg.get_value(dynet::concatenate_cols(score_exprs)));
+    unsigned n_actions = s.size() / beam.size();
+
+    transitions.clear();
+    for (unsigned i = 0; i < beam.size(); ++i) {
+      unsigned valid_mask = sys.get_valid_mask(beam[i].state);
+      const float * column = s.data() + i * n_actions;
+      for (unsigned a = 0; a < n_actions; ++a) {
+        if (!sys.is_valid_in(valid_mask, a)) { continue; }
+        transitions.push_back(std::make_tuple(i, a, beam[i].score + column[a]));
+      }
+    }
 
+    unsigned n_kept = std::min<unsigned>(beam_size, transitions.size());
+    std::partial_sort(transitions.begin(), transitions.begin() + n_kept, transitions.end(),
+                      [](const Transition& a, const Transition& b) { return std::get<2>(a) > std::get<2>(b); });
 
-      State& state = states[cursor];
-      State new_state(state);
-      StateCheckpoint * new_checkpoint = copy_checkpoint(checkpoints[cursor]);
-      sys.perform_action(new_state, action);
-      perform_action(action, new_state, cg, new_checkpoint);
+    next_beam.clear();
+    for (unsigned i = 0; i < n_kept; ++i) {
+      const Hypothesis & prev = beam[std::get<0>(transitions[i])];
+      unsigned action = std::get<1>(transitions[i]);
 
-      //      
-      states.push_back(new_state);
-      scores.push_back(new_score);
-      checkpoints.push_back(new_checkpoint);
-      next++;
+      next_beam.push_back(Hypothesis{ prev.state, std::get<2>(transitions[i]), copy_checkpoint(prev.checkpoint) });
+      Hypothesis & hyp = next_beam.back();
+      sys.perform_action(hyp.state, action);
+      perform_action(action, hyp.state, cg, hyp.checkpoint);
     }
+    // the dropped hypotheses are never visited again.
+    for (Hypothesis & hyp : beam) { destropy_checkpoint(hyp.checkpoint); }
+    beam.swap(next_beam);
   }
-  for (StateCheckpoint * checkpoint : checkpoints) {
-    destropy_checkpoint(checkpoint);
-  }
-  parses.resize(next - curr);
-  for (unsigned i = curr; i < next; ++i) {
-    Corpus::vector_to_parse_units(states[i].heads, states[i].deprels, parses[i - curr]);
+
+  // the hypotheses are kept sorted by partial_sort.
+  parses.resize(beam.size());
+  if (parse_scores != nullptr) { parse_scores->resize(beam.size()); }
+  for (unsigned i = 0; i < beam.size(); ++i) {
+    beam[i].state.to_parse_units(parses[i]);
+    if (parse_scores != nullptr) { (*parse_scores)[i] = beam[i].score; }
+    destropy_checkpoint(beam[i].checkpoint);
   }
 }
 
@@ -3,8 +3,10 @@
 
 #include "state.h"
 #include "system.h"
+#include "label_scorer.h"
 #include "dynet/lstm.h"
 #include "twpipe/corpus.h"
+#include "twpipe/word_encoding_cache.h"
 #include <vector>
 #include <unordered_map>
 #include <boost/program_options.hpp>
@@ -25,6 +27,10 @@ struct ParseModel {
   dynet::ParameterCollection & model;
   TransitionSystem & sys;
   EmbeddingType embedding_type_;
+  WordEncodingCache char_cache;
+  /// The labels of the factorized output, nullptr if the scorer of the model
+  /// scores all the actions at once.
+  LabelScorer * label_scorer;
 
   ParseModel(dynet::ParameterCollection & m,
              TransitionSystem& s,
@@ -35,6 +41,17 @@ struct ParseModel {
                std::vector<unsigned> & heads,
                std::vector<std::string> & deprels);
 
+  /// Parse with beam search and output the n_best highest-scored trees, best
+  /// first, with their scores (the sum of the action log-probabilities). A
+  /// beam of 1 is the greedy search, whose score is not computed.
+  void predict(const std::vector<std::string> & words,
+               const std::vector<std::string> & postags,
+               unsigned beam_size,
+               unsigned n_best,
+               std::vector<std::vector<unsigned>> & heads,
+               std::vector<std::vector<std::string>> & deprels,
+               std::vector<float> & scores);
+
   void label(const std::vector<std::string> & words,
              const std::vector<std::string> & postags,
              const std::vector<unsigned> & heads,
@@ -54,6 +71,29 @@ struct ParseModel {
                                  const InputUnits& input,
                                  StateCheckpoint * checkpoint) = 0;
 
+  /// The pretrained (static or contextual) embeddings of the input units,
+  /// including the pseudo root, as inputs of the graph.
+  void get_embeddings(dynet::ComputationGraph& cg,
+                      const InputUnits& input,
+                      std::vector<dynet::Expression>& embeddings);
+
+  /// The dimension of the char encoding of a word, 0 if the model doesn't
+  /// encode characters.
+  virtual unsigned get_char_encoding_dim() { return 0; }
+
+  /// The char encoding of a word from its char ids.
+  virtual dynet::Expression get_char_encoding(const std::vector<unsigned> & cids);
+
+  /// The char encodings of the input units w/o the pseudo root, through the
+  /// frozen table and the char cache.
+  void get_char_encodings(dynet::ComputationGraph& cg,
+                          const InputUnits& input,
+                          std::vector<dynet::Expression>& encodings);
+
+  /// Freeze the char encodings of the first n_words words of the word
+  /// alphabet. Only valid once the parameters are fixed.
+  void freeze(unsigned n_words);
+
   virtual void perform_action(const unsigned& action,
                               const State& state,
                               dynet::ComputationGraph& cg,
@@ -68,8 +108,29 @@ struct ParseModel {
 
   virtual void destropy_checkpoint(StateCheckpoint * checkpoint) = 0;
 
-  /// Get the un-softmaxed scores from the LSTM-parser.
-  virtual dynet::Expression get_scores(StateCheckpoint * checkpoint) = 0;
+  /// Get the hidden layer on which the actions are scored.
+  virtual dynet::Expression get_hidden(StateCheckpoint * checkpoint) = 0;
+
+  /// Get the output of the scorer of the model, the scores of all the actions
+  /// or, for the factorized output, those of the action classes.
+  virtual dynet::Expression get_scorer_output(const dynet::Expression & hidden) = 0;
+
+  /// Get the un-softmaxed scores of all the actions from the LSTM-parser. The
+  /// factorized output gives their log-probabilities.
+  dynet::Expression get_scores(StateCheckpoint * checkpoint);
+
+  /// Get the best valid action. The factorized output picks the best valid
+  /// action class first and only scores the labels of its direction.
+  virtual unsigned predict_action(dynet::ComputationGraph & cg,
+                                  StateCheckpoint * checkpoint,
+                                  unsigned valid_mask);
+
+  /// Get the best valid action class from the scores of the classes.
+  static unsigned get_best_class(const std::vector<float> & scores, unsigned valid_mask);
+
+  /// Precompute what only depends on the parameters to speed up parsing.
+  /// Only valid once the parameters are fixed.
+  virtual void precompute() {}
 
   virtual dynet::Expression l2() = 0;
   
@@ -86,7 +147,8 @@ struct ParseModel {
                    const InputUnits& input,
                    const unsigned& beam_size,
                    bool structure_score,
-                   std::vector<ParseUnits>& parse);
+                   std::vector<ParseUnits>& parse,
+                   std::vector<float> * scores = nullptr);
 };
 
 }
@@ -213,7 +213,8 @@ Ballesteros15Model::Ballesteros15Model(dynet::ParameterCollection & m,
                                        unsigned dim_lstm_in,
                                        unsigned dim_hidden,
                                        TransitionSystem& system,
-                                       EmbeddingType embedding_type) :
+                                       EmbeddingType embedding_type,
+                                       bool factorized) :
   ParseModel(m, system, embedding_type),
   fwd_ch_lstm(1, dim_c, dim_w, m),  /* We mannually fix the n-layers of char lstm to 1. */
   bwd_ch_lstm(1, dim_c, dim_w, m),
@@ -224,11 +225,10 @@ Ballesteros15Model::Ballesteros15Model(dynet::ParameterCollection & m,
   pos_emb(m, size_p, dim_p),
   act_emb(m, size_a, dim_a),
   rel_emb(m, size_a, dim_l),
-  pretrain_emb(dim_t),
   merge_input(m, dim_w + dim_w, dim_p, dim_t, dim_lstm_in),
   merge(m, dim_hidden, dim_hidden, dim_hidden, dim_hidden),
   composer(m, dim_lstm_in, dim_lstm_in, dim_l, dim_lstm_in),
-  scorer(m, dim_hidden, size_a),
+  scorer(m, dim_hidden, factorized ? TransitionSystem::N_ACTION_CLASSES : size_a),
   p_action_start(m.add_parameters({ dim_a })),
   p_buffer_guard(m.add_parameters({ dim_lstm_in })),
   p_stack_guard(m.add_parameters({ dim_lstm_in })),
@@ -242,6 +242,8 @@ Ballesteros15Model::Ballesteros15Model(dynet::ParameterCollection & m,
   size_a(size_a), dim_a(dim_a), dim_l(dim_l),
   n_layers(n_layers), dim_lstm_in(dim_lstm_in), dim_hidden(dim_hidden) {
 
+  if (factorized) { label_scorer = new LabelScorer(m, system, dim_hidden); }
+
   std::string system_name = system.name();
   if (system_name == "arcstd") {
     sys_func = new ArcStandardFunction();
@@ -267,13 +269,17 @@ void Ballesteros15Model::perform_action(const unsigned& action,
   sys_func->perform_action(action, cg, a_lstm, s_lstm, q_lstm, composer, *cp, act_repr, rel_repr);
 }
 
-dynet::Expression Ballesteros15Model::get_scores(ParseModel::StateCheckpoint * checkpoint) {
+dynet::Expression Ballesteros15Model::get_hidden(ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
-  return scorer.get_output(dynet::rectify(merge.get_output(
+  return dynet::rectify(merge.get_output(
     s_lstm.get_h(cp->s_pointer).back(),
     q_lstm.get_h(cp->q_pointer).back(),
     a_lstm.get_h(cp->a_pointer).back())
-  ));
+  );
+}
+
+dynet::Expression Ballesteros15Model::get_scorer_output(const dynet::Expression & hidden) {
+  return scorer.get_output(hidden);
 }
 
 dynet::Expression Ballesteros15Model::l2() {
@@ -287,6 +293,9 @@ dynet::Expression Ballesteros15Model::l2() {
   for (auto & e : merge.get_params()) { ret.push_back(dynet::squared_norm(e)); }
   for (auto & e : composer.get_params()) { ret.push_back(dynet::squared_norm(e)); }
   for (auto & e : scorer.get_params()) { ret.push_back(dynet::squared_norm(e)); }
+  if (label_scorer != nullptr) {
+    for (auto & e : label_scorer->get_params()) { ret.push_back(dynet::squared_norm(e)); }
+  }
   ret.push_back(dynet::squared_norm(buffer_guard));
   ret.push_back(dynet::squared_norm(stack_guard));
   ret.push_back(dynet::squared_norm(action_start));
@@ -326,12 +335,12 @@ void Ballesteros15Model::new_graph(dynet::ComputationGraph& cg) {
   pos_emb.new_graph(cg);
   act_emb.new_graph(cg);
   rel_emb.new_graph(cg);
-  pretrain_emb.new_graph(cg);
 
   merge_input.new_graph(cg);
   merge.new_graph(cg);
   composer.new_graph(cg);
   scorer.new_graph(cg);
+  if (label_scorer != nullptr) { label_scorer->new_graph(cg); }
 
   action_start = dynet::parameter(cg, p_action_start);
   buffer_guard = dynet::parameter(cg, p_buffer_guard);
@@ -341,37 +350,47 @@ void Ballesteros15Model::new_graph(dynet::ComputationGraph& cg) {
   root_word = dynet::parameter(cg, p_root_word);
 }
 
+unsigned Ballesteros15Model::get_char_encoding_dim() {
+  return dim_w + dim_w;
+}
+
+dynet::Expression Ballesteros15Model::get_char_encoding(const std::vector<unsigned> & cids) {
+  fwd_ch_lstm.start_new_sequence();
+  bwd_ch_lstm.start_new_sequence();
+  fwd_ch_lstm.add_input(word_start_guard);
+  bwd_ch_lstm.add_input(word_end_guard);
+  unsigned n_chars = cids.size();
+  for (unsigned j = 0; j < n_chars; ++j) {
+    fwd_ch_lstm.add_input(char_emb.embed(cids[j]));
+    bwd_ch_lstm.add_input(char_emb.embed(cids[n_chars - j - 1]));
+  }
+  fwd_ch_lstm.add_input(word_end_guard);
+  bwd_ch_lstm.add_input(word_start_guard);
+  return dynet::concatenate({ fwd_ch_lstm.back(), bwd_ch_lstm.back() });
+}
+
 void Ballesteros15Model::initialize_parser(dynet::ComputationGraph & cg,
                                            const InputUnits & input,
                                            ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
 
-  std::vector<std::vector<float>> embeddings;
+  std::vector<dynet::Expression> embeddings;
   unsigned len = input.size();
-  // The first unit is pseduo root.
-  if (embedding_type_ == kStaticEmbeddings) {
-    std::vector<std::string> words(len);
-    for (unsigned i = 0; i < len; ++i) { words[i] = input[i].word; }
-    WordEmbedding::get()->render(words, embeddings);
-  } else {
-    std::vector<std::string> words(len - 1);
-    // It is very tricky here! ELMo doesn't have the _ROOT_ token, so append a zero vector.
-    embeddings.emplace_back(std::vector<float>(ELMo::get()->dim(), 0.f));
-    for (unsigned i = 1; i < len; ++i) { words[i - 1] = input[i].word; }
-    ELMo::get()->render(words, embeddings);
-  }
+  get_embeddings(cg, input, embeddings);
+
+  std::vector<dynet::Expression> char_encodings;
+  get_char_encodings(cg, input, char_encodings);
 
   s_lstm.start_new_sequence();
   q_lstm.start_new_sequence();
   a_lstm.start_new_sequence();
   a_lstm.add_input(action_start);
 
-  cp->stack.clear();
-  cp->buffer.resize(len + 1);
+  std::vector<dynet::Expression> buffer_exprs(len + 1);
 
   // Pay attention to this, if the guard word is handled here, there is no need
   // to insert it when loading the data.
-  cp->buffer[0] = buffer_guard;
+  buffer_exprs[0] = buffer_guard;
   for (unsigned i = 0; i < len; ++i) {
     unsigned pid = input[i].pid;
 
@@ -380,27 +399,19 @@ void Ballesteros15Model::initialize_parser(dynet::ComputationGraph & cg,
       /// first element, the root.
       word_expr = root_word;
     } else {
-      fwd_ch_lstm.start_new_sequence();
-      bwd_ch_lstm.start_new_sequence();
-      fwd_ch_lstm.add_input(word_start_guard);
-      bwd_ch_lstm.add_input(word_end_guard);
-      unsigned n_chars = input[i].cids.size();
-      for (unsigned j = 0; j < n_chars; ++j) {
-        fwd_ch_lstm.add_input(char_emb.embed(input[i].cids[j]));
-        bwd_ch_lstm.add_input(char_emb.embed(input[i].cids[n_chars - j - 1]));
-      }
-      fwd_ch_lstm.add_input(word_end_guard);
-      bwd_ch_lstm.add_input(word_start_guard);
-      word_expr = dynet::concatenate({ fwd_ch_lstm.back(), bwd_ch_lstm.back() });
+      word_expr = char_encodings[i - 1];
     }
-    cp->buffer[len - i] = dynet::rectify(merge_input.get_output(
-      word_expr, pos_emb.embed(pid), pretrain_emb.get_output(embeddings[i])
+    buffer_exprs[len - i] = dynet::rectify(merge_input.get_output(
+      word_expr, pos_emb.embed(pid), embeddings[i]
     ));
   }
 
   // push word into buffer in reverse order, pay attention to (i == len).
+  cp->stack.clear();
+  cp->buffer.clear();
   for (unsigned i = 0; i <= len; ++i) {
-    q_lstm.add_input(cp->buffer[i]);
+    q_lstm.add_input(buffer_exprs[i]);
+    cp->buffer.push_back(buffer_exprs[i]);
   }
 
   s_lstm.add_input(stack_guard);
@@ -2,6 +2,7 @@
 #define __TWPIPE_PARSER_BALLESTEROS15_H__
 
 #include "parse_model.h"
+#include "persistent_stack.h"
 #include "state.h"
 #include "system.h"
 #include "twpipe/corpus.h"
@@ -20,8 +21,8 @@ struct Ballesteros15Model : public ParseModel {
     dynet::RNNPointer s_pointer;
     dynet::RNNPointer q_pointer;
     dynet::RNNPointer a_pointer;
-    std::vector<dynet::Expression> stack;
-    std::vector<dynet::Expression> buffer;
+    PersistentStack<dynet::Expression> stack;
+    PersistentStack<dynet::Expression> buffer;
   };
 
   struct TransitionSystemFunction {
@@ -96,7 +97,6 @@ struct Ballesteros15Model : public ParseModel {
   SymbolEmbedding pos_emb;
   SymbolEmbedding act_emb;
   SymbolEmbedding rel_emb;
-  InputLayer pretrain_emb;
 
   Merge3Layer merge_input;  // merge (2 * word, pos, preword)
   Merge3Layer merge;        // merge (s_lstm, q_lstm, a_lstm)
@@ -144,10 +144,15 @@ struct Ballesteros15Model : public ParseModel {
                               unsigned dim_lstm_in,
                               unsigned dim_hidden,
                               TransitionSystem& system,
-                              EmbeddingType embedding_type);
+                              EmbeddingType embedding_type,
+                              bool factorized = false);
 
   void new_graph(dynet::ComputationGraph& cg) override;
 
+  unsigned get_char_encoding_dim() override;
+
+  dynet::Expression get_char_encoding(const std::vector<unsigned> & cids) override;
+
   void initialize_parser(dynet::ComputationGraph& cg,
                          const InputUnits& input,
                          StateCheckpoint * checkpoint) override;
@@ -163,8 +168,9 @@ struct Ballesteros15Model : public ParseModel {
 
   void destropy_checkpoint(StateCheckpoint * checkpoint) override;
 
-  /// Get the un-softmaxed scores from the LSTM-parser.
-  dynet::Expression get_scores(StateCheckpoint * checkpoint) override;
+  dynet::Expression get_hidden(StateCheckpoint * checkpoint) override;
+
+  dynet::Expression get_scorer_output(const dynet::Expression & hidden) override;
 
   dynet::Expression l2() override;
 };
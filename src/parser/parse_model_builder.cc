@@ -42,6 +42,8 @@ ParseModelBuilder::ParseModelBuilder(po::variables_map & conf) {
   n_layers = (conf.count("parse-n-layer") ? conf["parse-n-layer"].as<unsigned>() : 0);
   lstm_input_dim = (conf.count("parse-lstm-input-dim") ? conf["parse-lstm-input-dim"].as<unsigned>() : 0);
   hidden_dim = (conf.count("parse-hidden-dim") ? conf["parse-hidden-dim"].as<unsigned>() : 0);
+  freeze_size = (conf.count("parse-freeze-size") ? conf["parse-freeze-size"].as<unsigned>() : 0);
+  factorized = (conf.count("parse-factorized-scorer") ? conf["parse-factorized-scorer"].as<bool>() : false);
 }
 
 ParseModel * ParseModelBuilder::build(dynet::ParameterCollection & model) {
@@ -75,7 +77,8 @@ ParseModel * ParseModelBuilder::build(dynet::ParameterCollection & model) {
                              lstm_input_dim,
                              hidden_dim,
                              (*system),
-                             embedding_type);
+                             embedding_type,
+                             factorized);
 
   } else if (arch_name == "ballesteros15" || arch_name == "b15") {
     parser = new Ballesteros15Model(model,
@@ -92,7 +95,8 @@ ParseModel * ParseModelBuilder::build(dynet::ParameterCollection & model) {
                                     lstm_input_dim,
                                     hidden_dim,
                                     (*system),
-                                    embedding_type);
+                                    embedding_type,
+                                    factorized);
 
   } else if (arch_name == "kiperwasser16" || arch_name == "k16") {
     parser = new Kiperwasser16Model(model,
@@ -106,7 +110,8 @@ ParseModel * ParseModelBuilder::build(dynet::ParameterCollection & model) {
                                     lstm_input_dim,
                                     hidden_dim,
                                     (*system),
-                                    embedding_type);
+                                    embedding_type,
+                                    factorized);
   } else {
     _ERROR << "[parse|model_builder] unknown architecture name: " << arch_name;
     exit(1);
@@ -124,7 +129,8 @@ void ParseModelBuilder::to_json() {
     { "lstm-input-dim", boost::lexical_cast<std::string>(lstm_input_dim) },
     { "hidden-dim", boost::lexical_cast<std::string>(hidden_dim) },
     { "n-layers", boost::lexical_cast<std::string>(n_layers) },
-    { "emb-dim", boost::lexical_cast<std::string>(embed_dim) }
+    { "emb-dim", boost::lexical_cast<std::string>(embed_dim) },
+    { "factorized-scorer", boost::lexical_cast<std::string>(factorized) }
   });
 
   if (arch_name == "dyer15" || arch_name == "d15") {
@@ -184,6 +190,8 @@ ParseModel * ParseModelBuilder::from_json(dynet::ParameterCollection & model) {
     boost::lexical_cast<unsigned>(globals->from_json(Model::kParserName, "n-layers"));
   embed_dim =
     boost::lexical_cast<unsigned>(globals->from_json(Model::kParserName, "emb-dim"));
+  // models saved before the factorized output have the flat one.
+  factorized = (globals->from_json(Model::kParserName, "factorized-scorer") == "1");
 
   if (arch_name == "dyer15" || arch_name == "d15") {
     temp_size =
@@ -237,6 +245,10 @@ ParseModel * ParseModelBuilder::from_json(dynet::ParameterCollection & model) {
   }
   engine = build(model);
   globals->from_json(Model::kParserName, model);
+  // the parameters are fixed from now on.
+  engine->char_cache.set_enabled(true);
+  engine->freeze(freeze_size);
+  engine->precompute();
   return engine;
 }
 
@@ -28,6 +28,8 @@ struct ParseModelBuilder {
   unsigned n_layers;
   unsigned lstm_input_dim;
   unsigned hidden_dim;
+  unsigned freeze_size;
+  bool factorized;
   EmbeddingType embedding_type;
 
   ParseModelBuilder(po::variables_map & conf);
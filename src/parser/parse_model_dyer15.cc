@@ -210,7 +210,8 @@ Dyer15Model::Dyer15Model(dynet::ParameterCollection & m,
                          unsigned dim_lstm_in,
                          unsigned dim_hidden,
                          TransitionSystem& system,
-                         EmbeddingType embedding_type) :
+                         EmbeddingType embedding_type,
+                         bool factorized) :
   ParseModel(m, system, embedding_type),
   s_lstm(n_layers, dim_lstm_in, dim_hidden, m),
   q_lstm(n_layers, dim_lstm_in, dim_hidden, m),
@@ -219,11 +220,10 @@ Dyer15Model::Dyer15Model(dynet::ParameterCollection & m,
   pos_emb(m, size_p, dim_p),
   act_emb(m, size_a, dim_a),
   rel_emb(m, size_a, dim_l),
-  pretrain_emb(dim_t),
   merge_input(m, dim_w, dim_p, dim_t, dim_lstm_in),
   merge(m, dim_hidden, dim_hidden, dim_hidden, dim_hidden),
   composer(m, dim_lstm_in, dim_lstm_in, dim_l, dim_lstm_in),
-  scorer(m, dim_hidden, size_a),
+  scorer(m, dim_hidden, factorized ? TransitionSystem::N_ACTION_CLASSES : size_a),
   p_action_start(m.add_parameters({ dim_a })),
   p_buffer_guard(m.add_parameters({ dim_lstm_in })),
   p_stack_guard(m.add_parameters({ dim_lstm_in })),
@@ -234,6 +234,8 @@ Dyer15Model::Dyer15Model(dynet::ParameterCollection & m,
   size_a(size_a), dim_a(dim_a), dim_l(dim_l),
   n_layers(n_layers), dim_lstm_in(dim_lstm_in), dim_hidden(dim_hidden) {
 
+  if (factorized) { label_scorer = new LabelScorer(m, system, dim_hidden); }
+
   std::string system_name = system.name();
 
   if (system_name == "arcstd") {
@@ -279,13 +281,17 @@ void Dyer15Model::destropy_checkpoint(StateCheckpoint * checkpoint) {
   delete dynamic_cast<StateCheckpointImpl *>(checkpoint);
 }
 
-dynet::Expression Dyer15Model::get_scores(ParseModel::StateCheckpoint * checkpoint) {
+dynet::Expression Dyer15Model::get_hidden(ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
-  return scorer.get_output(dynet::rectify(merge.get_output(
+  return dynet::rectify(merge.get_output(
     s_lstm.get_h(cp->s_pointer).back(),
     q_lstm.get_h(cp->q_pointer).back(),
     a_lstm.get_h(cp->a_pointer).back())
-  ));
+  );
+}
+
+dynet::Expression Dyer15Model::get_scorer_output(const dynet::Expression & hidden) {
+  return scorer.get_output(hidden);
 }
 
 dynet::Expression Dyer15Model::l2() {
@@ -297,6 +303,9 @@ dynet::Expression Dyer15Model::l2() {
   for (auto & e : merge.get_params()) { ret.push_back(dynet::squared_norm(e)); }
   for (auto & e : composer.get_params()) { ret.push_back(dynet::squared_norm(e)); }
   for (auto & e : scorer.get_params()) { ret.push_back(dynet::squared_norm(e)); }
+  if (label_scorer != nullptr) {
+    for (auto & e : label_scorer->get_params()) { ret.push_back(dynet::squared_norm(e)); }
+  }
   ret.push_back(dynet::squared_norm(buffer_guard));
   ret.push_back(dynet::squared_norm(stack_guard));
   ret.push_back(dynet::squared_norm(action_start));
@@ -310,7 +319,6 @@ void Dyer15Model::new_graph(dynet::ComputationGraph& cg) {
 
   word_emb.new_graph(cg);
   pos_emb.new_graph(cg);
-  pretrain_emb.new_graph(cg);
   act_emb.new_graph(cg);
   rel_emb.new_graph(cg);
 
@@ -318,6 +326,7 @@ void Dyer15Model::new_graph(dynet::ComputationGraph& cg) {
   merge.new_graph(cg);
   composer.new_graph(cg);
   scorer.new_graph(cg);
+  if (label_scorer != nullptr) { label_scorer->new_graph(cg); }
 
   action_start = dynet::parameter(cg, p_action_start);
   buffer_guard = dynet::parameter(cg, p_buffer_guard);
@@ -329,44 +338,35 @@ void Dyer15Model::initialize_parser(dynet::ComputationGraph & cg,
                                     ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
   
-  std::vector<std::vector<float>> embeddings;
+  std::vector<dynet::Expression> embeddings;
   unsigned len = input.size();
-  // The first unit is pseduo root.
-  if (embedding_type_ == kStaticEmbeddings) {
-    std::vector<std::string> words(len);
-    for (unsigned i = 0; i < len; ++i) { words[i] = input[i].word; }
-    WordEmbedding::get()->render(words, embeddings);
-  } else {
-    std::vector<std::string> words(len - 1);
-    // It is very tricky here! ELMo doesn't have the _ROOT_ token, so append a zero vector.
-    embeddings.emplace_back(std::vector<float>(ELMo::get()->dim(), 0.f));
-    for (unsigned i = 1; i < len; ++i) { words[i - 1] = input[i].word; }
-    ELMo::get()->render(words, embeddings);
-  }
+  get_embeddings(cg, input, embeddings);
 
   s_lstm.start_new_sequence();
   q_lstm.start_new_sequence();
   a_lstm.start_new_sequence();
   a_lstm.add_input(action_start);
 
-  cp->stack.clear();
-  cp->buffer.resize(len + 1);
+  std::vector<dynet::Expression> buffer_exprs(len + 1);
 
   // Pay attention to this, if the guard word is handled here, there is no need
   // to insert it when loading the data.
-  cp->buffer[0] = buffer_guard;
+  buffer_exprs[0] = buffer_guard;
   for (unsigned i = 0; i < len; ++i) {
     unsigned wid = input[i].wid;
     unsigned pid = input[i].pid;
 
-    cp->buffer[len - i] = dynet::rectify(merge_input.get_output(
-      word_emb.embed(wid), pos_emb.embed(pid), pretrain_emb.get_output(embeddings[i])
+    buffer_exprs[len - i] = dynet::rectify(merge_input.get_output(
+      word_emb.embed(wid), pos_emb.embed(pid), embeddings[i]
     ));
   }
 
   // push word into buffer in reverse order, pay attention to (i == len).
+  cp->stack.clear();
+  cp->buffer.clear();
   for (unsigned i = 0; i <= len; ++i) {
-    q_lstm.add_input(cp->buffer[i]);
+    q_lstm.add_input(buffer_exprs[i]);
+    cp->buffer.push_back(buffer_exprs[i]);
   }
 
   s_lstm.add_input(stack_guard);
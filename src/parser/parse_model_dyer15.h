@@ -2,6 +2,7 @@
 #define __TWPIPE_PARSER_DYER15_H__
 
 #include "parse_model.h"
+#include "persistent_stack.h"
 #include "state.h"
 #include "system.h"
 #include "dynet_layer/layer.h"
@@ -21,8 +22,8 @@ struct Dyer15Model : public ParseModel {
     dynet::RNNPointer s_pointer;
     dynet::RNNPointer q_pointer;
     dynet::RNNPointer a_pointer;
-    std::vector<dynet::Expression> stack;
-    std::vector<dynet::Expression> buffer;
+    PersistentStack<dynet::Expression> stack;
+    PersistentStack<dynet::Expression> buffer;
   };
 
   struct TransitionSystemFunction {
@@ -94,7 +95,6 @@ struct Dyer15Model : public ParseModel {
   SymbolEmbedding pos_emb;
   SymbolEmbedding act_emb;
   SymbolEmbedding rel_emb;
-  InputLayer pretrain_emb;
 
   Merge3Layer merge_input;  // merge (word, pos, preword)
   Merge3Layer merge;        // merge (s_lstm, q_lstm, a_lstm)
@@ -128,7 +128,8 @@ struct Dyer15Model : public ParseModel {
                        unsigned dim_lstm_in,
                        unsigned dim_hidden,
                        TransitionSystem& system,
-                       EmbeddingType embedding_type);
+                       EmbeddingType embedding_type,
+                       bool factorized = false);
 
   void new_graph(dynet::ComputationGraph& cg) override;
 
@@ -147,8 +148,9 @@ struct Dyer15Model : public ParseModel {
 
   void destropy_checkpoint(StateCheckpoint * checkpoint) override;
 
-  /// Get the un-softmaxed scores from the LSTM-parser.
-  dynet::Expression get_scores(StateCheckpoint * checkpoint) override;
+  dynet::Expression get_hidden(StateCheckpoint * checkpoint) override;
+
+  dynet::Expression get_scorer_output(const dynet::Expression & hidden) override;
 
   dynet::Expression l2() override;
 };
@@ -2,62 +2,59 @@
 #include "twpipe/logging.h"
 #include "twpipe/embedding.h"
 #include "twpipe/elmo.h"
+#include <cmath>
 
 namespace twpipe {
 
-void Kiperwasser16Model::ArcEagerFunction::extract_feature(std::vector<dynet::Expression>& encoded,
-                                                           dynet::Expression& empty,
-                                                           Kiperwasser16Model::StateCheckpointImpl & cp,
-                                                           const State& state) {
+void Kiperwasser16Model::ArcEagerFunction::extract_feature(const State& state,
+                                                           unsigned n_words,
+                                                           unsigned positions[4]) {
   // S1, S0, B0, B1
   // should do after sys.perform_action
   unsigned stack_size = state.stack.size();
-  if (stack_size > 2) { cp.f0 = encoded[state.stack[stack_size - 2]]; } else { cp.f0 = empty; }
-  if (stack_size > 1) { cp.f1 = encoded[state.stack[stack_size - 1]]; } else { cp.f1 = empty; }
+  positions[0] = (stack_size > 2 ? state.stack[stack_size - 2] : n_words);
+  positions[1] = (stack_size > 1 ? state.stack[stack_size - 1] : n_words);
 
   unsigned buffer_size = state.buffer.size();
-  if (buffer_size > 1) { cp.f2 = encoded[state.buffer[buffer_size - 1]]; } else { cp.f2 = empty; }
-  if (buffer_size > 2) { cp.f3 = encoded[state.buffer[buffer_size - 2]]; } else { cp.f3 = empty; }
+  positions[2] = (buffer_size > 1 ? state.buffer[buffer_size - 1] : n_words);
+  positions[3] = (buffer_size > 2 ? state.buffer[buffer_size - 2] : n_words);
 }
 
-void Kiperwasser16Model::ArcStandardFunction::extract_feature(std::vector<dynet::Expression> & encoded,
-                                                              dynet::Expression & empty,
-                                                              Kiperwasser16Model::StateCheckpointImpl & cp,
-                                                              const State& state) {
+void Kiperwasser16Model::ArcStandardFunction::extract_feature(const State& state,
+                                                              unsigned n_words,
+                                                              unsigned positions[4]) {
   // should considering the guard in state and buffer.
   unsigned stack_size = state.stack.size();
-  if (stack_size > 3) { cp.f0 = encoded[state.stack[stack_size - 3]]; } else { cp.f0 = empty; }
-  if (stack_size > 2) { cp.f1 = encoded[state.stack[stack_size - 2]]; } else { cp.f1 = empty; }
-  if (stack_size > 1) { cp.f2 = encoded[state.stack[stack_size - 1]]; } else { cp.f2 = empty; }
+  positions[0] = (stack_size > 3 ? state.stack[stack_size - 3] : n_words);
+  positions[1] = (stack_size > 2 ? state.stack[stack_size - 2] : n_words);
+  positions[2] = (stack_size > 1 ? state.stack[stack_size - 1] : n_words);
 
   unsigned buffer_size = state.buffer.size();
-  if (buffer_size > 1) { cp.f3 = encoded[state.buffer[buffer_size - 1]]; } else { cp.f3 = empty; }
+  positions[3] = (buffer_size > 1 ? state.buffer[buffer_size - 1] : n_words);
 }
 
-void Kiperwasser16Model::ArcHybridFunction::extract_feature(std::vector<dynet::Expression>& encoded,
-                                                            dynet::Expression & empty,
-                                                            Kiperwasser16Model::StateCheckpointImpl & cp,
-                                                            const State& state) {
+void Kiperwasser16Model::ArcHybridFunction::extract_feature(const State& state,
+                                                            unsigned n_words,
+                                                            unsigned positions[4]) {
   unsigned stack_size = state.stack.size();
-  if (stack_size > 3) { cp.f0 = encoded[state.stack[stack_size - 3]]; } else { cp.f0 = empty; }
-  if (stack_size > 2) { cp.f1 = encoded[state.stack[stack_size - 2]]; } else { cp.f1 = empty; }
-  if (stack_size > 1) { cp.f2 = encoded[state.stack[stack_size - 1]]; } else { cp.f2 = empty; }
+  positions[0] = (stack_size > 3 ? state.stack[stack_size - 3] : n_words);
+  positions[1] = (stack_size > 2 ? state.stack[stack_size - 2] : n_words);
+  positions[2] = (stack_size > 1 ? state.stack[stack_size - 1] : n_words);
 
   unsigned buffer_size = state.buffer.size();
-  if (buffer_size > 1) { cp.f3 = encoded[state.buffer[buffer_size - 1]]; } else { cp.f3 = empty; }
+  positions[3] = (buffer_size > 1 ? state.buffer[buffer_size - 1] : n_words);
 }
 
-void Kiperwasser16Model::SwapFunction::extract_feature(std::vector<dynet::Expression>& encoded,
-                                                       dynet::Expression& empty,
-                                                       Kiperwasser16Model::StateCheckpointImpl & cp,
-                                                       const State& state) {
+void Kiperwasser16Model::SwapFunction::extract_feature(const State& state,
+                                                       unsigned n_words,
+                                                       unsigned positions[4]) {
   unsigned stack_size = state.stack.size();
-  if (stack_size > 3) { cp.f0 = encoded[state.stack[stack_size - 3]]; } else { cp.f0 = empty; }
-  if (stack_size > 2) { cp.f1 = encoded[state.stack[stack_size - 2]]; } else { cp.f1 = empty; }
-  if (stack_size > 1) { cp.f2 = encoded[state.stack[stack_size - 1]]; } else { cp.f2 = empty; }
+  positions[0] = (stack_size > 3 ? state.stack[stack_size - 3] : n_words);
+  positions[1] = (stack_size > 2 ? state.stack[stack_size - 2] : n_words);
+  positions[2] = (stack_size > 1 ? state.stack[stack_size - 1] : n_words);
 
   unsigned buffer_size = state.buffer.size();
-  if (buffer_size > 1) { cp.f3 = encoded[state.buffer[buffer_size - 1]]; } else { cp.f3 = empty; }
+  positions[3] = (buffer_size > 1 ? state.buffer[buffer_size - 1] : n_words);
 }
 
 Kiperwasser16Model::Kiperwasser16Model(dynet::ParameterCollection & m,
@@ -71,16 +68,16 @@ Kiperwasser16Model::Kiperwasser16Model(dynet::ParameterCollection & m,
                                        unsigned dim_lstm_in,
                                        unsigned dim_hidden,
                                        TransitionSystem & system,
-                                       EmbeddingType embedding_type) :
+                                       EmbeddingType embedding_type,
+                                       bool factorized) :
   ParseModel(m, system, embedding_type),
   fwd_lstm(n_layers, dim_lstm_in, dim_hidden / 2, m),
   bwd_lstm(n_layers, dim_lstm_in, dim_hidden / 2, m),
   word_emb(m, size_w, dim_w),
   pos_emb(m, size_p, dim_p),
-  pretrain_emb(dim_t),
   merge_input(m, dim_w, dim_p, dim_t, dim_lstm_in),
   merge(m, dim_hidden, dim_hidden, dim_hidden, dim_hidden, dim_hidden),
-  scorer(m, dim_hidden, size_a),
+  scorer(m, dim_hidden, factorized ? TransitionSystem::N_ACTION_CLASSES : size_a),
   p_empty(m.add_parameters({ dim_hidden })),
   p_fwd_guard(m.add_parameters({ dim_lstm_in })),
   p_bwd_guard(m.add_parameters({ dim_lstm_in })),
@@ -89,7 +86,12 @@ Kiperwasser16Model::Kiperwasser16Model(dynet::ParameterCollection & m,
   size_p(size_p), dim_p(dim_p),
   dim_t(dim_t),
   size_a(size_a),
-  n_layers(n_layers), dim_lstm_in(dim_lstm_in), dim_hidden(dim_hidden) {
+  n_layers(n_layers), dim_lstm_in(dim_lstm_in), dim_hidden(dim_hidden),
+  precomputed(false),
+  n_scores(factorized ? TransitionSystem::N_ACTION_CLASSES : size_a),
+  features_ready(false) {
+
+  if (factorized) { label_scorer = new LabelScorer(m, system, dim_hidden); }
 
   std::string system_name = system.name();
   if (system_name == "arcstd") {
@@ -111,10 +113,10 @@ void Kiperwasser16Model::new_graph(dynet::ComputationGraph & cg) {
   bwd_lstm.new_graph(cg);
   word_emb.new_graph(cg);
   pos_emb.new_graph(cg);
-  pretrain_emb.new_graph(cg);
   merge_input.new_graph(cg);
   merge.new_graph(cg);
   scorer.new_graph(cg);
+  if (label_scorer != nullptr) { label_scorer->new_graph(cg); }
 
   fwd_guard = dynet::parameter(cg, p_fwd_guard);
   bwd_guard = dynet::parameter(cg, p_bwd_guard);
@@ -126,20 +128,9 @@ void Kiperwasser16Model::initialize_parser(dynet::ComputationGraph & cg,
                                            ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
 
-  std::vector<std::vector<float>> embeddings;
+  std::vector<dynet::Expression> embeddings;
   unsigned len = input.size();
-  // The first unit is pseduo root.
-  if (embedding_type_ == kStaticEmbeddings) {
-    std::vector<std::string> words(len);
-    for (unsigned i = 0; i < len; ++i) { words[i] = input[i].word; }
-    WordEmbedding::get()->render(words, embeddings);
-  } else {
-    std::vector<std::string> words(len - 1);
-    // It is very tricky here! ELMo doesn't have the _ROOT_ token, so append a zero vector.
-    embeddings.emplace_back(std::vector<float>(ELMo::get()->dim(), 0.f));
-    for (unsigned i = 1; i < len; ++i) { words[i - 1] = input[i].word; }
-    ELMo::get()->render(words, embeddings);
-  }
+  get_embeddings(cg, input, embeddings);
 
   fwd_lstm.start_new_sequence();
   bwd_lstm.start_new_sequence();
@@ -150,7 +141,7 @@ void Kiperwasser16Model::initialize_parser(dynet::ComputationGraph & cg,
     unsigned pid = input[i].pid;
 
     lstm_input[i] = dynet::rectify(merge_input.get_output(
-      word_emb.embed(wid), pos_emb.embed(pid), pretrain_emb.get_output(embeddings[i])));
+      word_emb.embed(wid), pos_emb.embed(pid), embeddings[i]));
   }
 
   fwd_lstm.add_input(fwd_guard);
@@ -170,7 +161,31 @@ void Kiperwasser16Model::initialize_parser(dynet::ComputationGraph & cg,
 
   State state(len);
   initialize_state(input, state);
-  sys_func->extract_feature(encoded, empty, *cp, state);
+  sys_func->extract_feature(state, len, cp->positions);
+  features_ready = false;
+}
+
+void Kiperwasser16Model::compute_feature_values(dynet::ComputationGraph & cg) {
+  unsigned len = encoded.size();
+  // column i of the dim_hidden x (len + 1) matrix is encoded[i], the last one is empty.
+  std::vector<dynet::Expression> columns(encoded);
+  columns.push_back(empty);
+  std::vector<float> values = dynet::as_vector(cg.get_value(dynet::concatenate_cols(columns)));
+  for (unsigned k = 0; k < 4; ++k) {
+    const std::vector<float> & weights = merge_weights[k];
+    std::vector<float> & output = feature_values[k];
+    output.assign((len + 1) * dim_hidden, 0.f);
+    for (unsigned i = 0; i <= len; ++i) {
+      float * y = output.data() + i * dim_hidden;
+      const float * x = values.data() + i * dim_hidden;
+      for (unsigned j = 0; j < dim_hidden; ++j) {
+        const float * w = weights.data() + j * dim_hidden;
+        float xj = x[j];
+        for (unsigned r = 0; r < dim_hidden; ++r) { y[r] += w[r] * xj; }
+      }
+    }
+  }
+  features_ready = true;
 }
 
 void Kiperwasser16Model::perform_action(const unsigned & action,
@@ -178,7 +193,7 @@ void Kiperwasser16Model::perform_action(const unsigned & action,
                                         dynet::ComputationGraph & cg,
                                         ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
-  sys_func->extract_feature(encoded, empty, *cp, state);
+  sys_func->extract_feature(state, encoded.size(), cp->positions);
 }
 
 ParseModel::StateCheckpoint * Kiperwasser16Model::get_initial_checkpoint() {
@@ -188,10 +203,7 @@ ParseModel::StateCheckpoint * Kiperwasser16Model::get_initial_checkpoint() {
 ParseModel::StateCheckpoint * Kiperwasser16Model::copy_checkpoint(StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
   auto * new_checkpoint = new StateCheckpointImpl();
-  new_checkpoint->f0 = cp->f0;
-  new_checkpoint->f1 = cp->f1;
-  new_checkpoint->f2 = cp->f2;
-  new_checkpoint->f3 = cp->f3;
+  for (unsigned k = 0; k < 4; ++k) { new_checkpoint->positions[k] = cp->positions[k]; }
   return new_checkpoint;
 }
 
@@ -199,9 +211,85 @@ void Kiperwasser16Model::destropy_checkpoint(StateCheckpoint * checkpoint) {
   delete dynamic_cast<StateCheckpointImpl *>(checkpoint);
 }
 
-dynet::Expression Kiperwasser16Model::get_scores(ParseModel::StateCheckpoint * checkpoint) {
+dynet::Expression Kiperwasser16Model::get_hidden(ParseModel::StateCheckpoint * checkpoint) {
   auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
-  return scorer.get_output(dynet::tanh(merge.get_output(cp->f0, cp->f1, cp->f2, cp->f3)));
+  return dynet::tanh(merge.get_output(get_feature(cp->positions[0]),
+                                     get_feature(cp->positions[1]),
+                                     get_feature(cp->positions[2]),
+                                     get_feature(cp->positions[3])));
+}
+
+dynet::Expression Kiperwasser16Model::get_feature(unsigned position) {
+  return (position < encoded.size() ? encoded[position] : empty);
+}
+
+dynet::Expression Kiperwasser16Model::get_scorer_output(const dynet::Expression & hidden) {
+  return scorer.get_output(hidden);
+}
+
+unsigned Kiperwasser16Model::predict_action(dynet::ComputationGraph & cg,
+                                            ParseModel::StateCheckpoint * checkpoint,
+                                            unsigned valid_mask) {
+  if (!precomputed) { return ParseModel::predict_action(cg, checkpoint, valid_mask); }
+
+  if (!features_ready) { compute_feature_values(cg); }
+  auto * cp = dynamic_cast<StateCheckpointImpl *>(checkpoint);
+  const float * f0 = feature_values[0].data() + cp->positions[0] * dim_hidden;
+  const float * f1 = feature_values[1].data() + cp->positions[1] * dim_hidden;
+  const float * f2 = feature_values[2].data() + cp->positions[2] * dim_hidden;
+  const float * f3 = feature_values[3].data() + cp->positions[3] * dim_hidden;
+  const float * b = merge_bias.data();
+  float * h = hidden_values.data();
+  for (unsigned r = 0; r < dim_hidden; ++r) { h[r] = std::tanh(b[r] + f0[r] + f1[r] + f2[r] + f3[r]); }
+
+  float * s = score_values.data();
+  for (unsigned o = 0; o < n_scores; ++o) { s[o] = scorer_bias[o]; }
+  for (unsigned j = 0; j < dim_hidden; ++j) {
+    const float * w = scorer_weights.data() + j * n_scores;
+    float hj = h[j];
+    for (unsigned o = 0; o < n_scores; ++o) { s[o] += w[o] * hj; }
+  }
+
+  if (label_scorer == nullptr) { return sys.get_best_action(score_values, valid_mask).first; }
+  // the labels of the chosen direction are still scored in the graph.
+  dynet::Expression hidden = dynet::input(cg, { dim_hidden }, hidden_values);
+  return label_scorer->get_best_action(hidden, get_best_class(score_values, valid_mask));
+}
+
+void Kiperwasser16Model::precompute() {
+  // the affine layers are read through their outputs on the zero and the unit
+  // vectors, so nothing depends on how the layers store their parameters.
+  dynet::ComputationGraph cg;
+  new_graph(cg);
+  dynet::Expression zero = dynet::zeroes(cg, { dim_hidden });
+  dynet::Expression merge_b = merge.get_output(zero, zero, zero, zero);
+  dynet::Expression scorer_b = scorer.get_output(zero);
+
+  std::vector<dynet::Expression> merge_columns[4];
+  std::vector<dynet::Expression> scorer_columns;
+  for (unsigned j = 0; j < dim_hidden; ++j) {
+    std::vector<float> unit_values(dim_hidden, 0.f);
+    unit_values[j] = 1.f;
+    dynet::Expression unit = dynet::input(cg, { dim_hidden }, unit_values);
+    merge_columns[0].push_back(merge.get_output(unit, zero, zero, zero) - merge_b);
+    merge_columns[1].push_back(merge.get_output(zero, unit, zero, zero) - merge_b);
+    merge_columns[2].push_back(merge.get_output(zero, zero, unit, zero) - merge_b);
+    merge_columns[3].push_back(merge.get_output(zero, zero, zero, unit) - merge_b);
+    scorer_columns.push_back(scorer.get_output(unit) - scorer_b);
+  }
+
+  merge_bias = dynet::as_vector(cg.incremental_forward(merge_b));
+  scorer_bias = dynet::as_vector(cg.incremental_forward(scorer_b));
+  for (unsigned k = 0; k < 4; ++k) {
+    merge_weights[k] = dynet::as_vector(cg.incremental_forward(dynet::concatenate_cols(merge_columns[k])));
+  }
+  scorer_weights = dynet::as_vector(cg.incremental_forward(dynet::concatenate_cols(scorer_columns)));
+  BOOST_ASSERT_MSG(scorer_bias.size() == n_scores, "[parse|k16] unexpected scorer size.");
+
+  hidden_values.resize(dim_hidden);
+  score_values.resize(n_scores);
+  precomputed = true;
+  _INFO << "[parse|k16] precomputed the merge and scorer layers.";
 }
 
 dynet::Expression Kiperwasser16Model::l2() {
@@ -211,6 +299,9 @@ dynet::Expression Kiperwasser16Model::l2() {
   for (auto & e : merge_input.get_params()) { ret.push_back(dynet::squared_norm(e)); }
   for (auto & e : merge.get_params()) { ret.push_back(dynet::squared_norm(e)); }
   for (auto & e : scorer.get_params()) { ret.push_back(dynet::squared_norm(e)); }
+  if (label_scorer != nullptr) {
+    for (auto & e : label_scorer->get_params()) { ret.push_back(dynet::squared_norm(e)); }
+  }
   ret.push_back(dynet::squared_norm(empty));
   ret.push_back(dynet::squared_norm(fwd_guard));
   ret.push_back(dynet::squared_norm(bwd_guard));
@@ -15,52 +15,45 @@ struct Kiperwasser16Model : public ParseModel {
     /// state machine
     ~StateCheckpointImpl() {}
 
-    dynet::Expression f0;
-    dynet::Expression f1;
-    dynet::Expression f2;
-    dynet::Expression f3;
+    /// The positions of the four features in the encodings.
+    unsigned positions[4];
   };
 
   struct TransitionSystemFunction {
-    virtual void extract_feature(std::vector<dynet::Expression>& encoded,
-                                 dynet::Expression & empty,
-                                 StateCheckpointImpl & checkpoint,
-                                 const State & state) = 0;
+    /// Get the positions of the four features, n_words for the empty one.
+    virtual void extract_feature(const State & state,
+                                 unsigned n_words,
+                                 unsigned positions[4]) = 0;
   };
 
   struct ArcEagerFunction : public TransitionSystemFunction {
-    void extract_feature(std::vector<dynet::Expression>& encoded,
-                         dynet::Expression& empty,
-                         StateCheckpointImpl & checkpoint,
-                         const State& state) override;
+    void extract_feature(const State & state,
+                         unsigned n_words,
+                         unsigned positions[4]) override;
   };
 
   struct ArcStandardFunction : public TransitionSystemFunction {
-    void extract_feature(std::vector<dynet::Expression>& encoded,
-                         dynet::Expression & empty,
-                         StateCheckpointImpl & checkpoint,
-                         const State & state) override;
+    void extract_feature(const State & state,
+                         unsigned n_words,
+                         unsigned positions[4]) override;
   };
 
   struct ArcHybridFunction : public TransitionSystemFunction {
-    void extract_feature(std::vector<dynet::Expression>& encoded,
-                         dynet::Expression& empty,
-                         StateCheckpointImpl & checkpoint,
-                         const State & state) override;
+    void extract_feature(const State & state,
+                         unsigned n_words,
+                         unsigned positions[4]) override;
   };
 
   struct SwapFunction : public TransitionSystemFunction {
-    void extract_feature(std::vector<dynet::Expression>& encoded,
-                         dynet::Expression& empty,
-                         StateCheckpointImpl & checkpoint,
-                         const State& state) override;
+    void extract_feature(const State & state,
+                         unsigned n_words,
+                         unsigned positions[4]) override;
   };
 
   LSTMBuilderType fwd_lstm;
   LSTMBuilderType bwd_lstm;
   SymbolEmbedding word_emb;
   SymbolEmbedding pos_emb;
-  InputLayer pretrain_emb;
 
   Merge3Layer merge_input;
   Merge4Layer merge;        // merge (s2, s1, s0, n0)
@@ -79,6 +72,24 @@ struct Kiperwasser16Model : public ParseModel {
   unsigned size_w, dim_w, size_p, dim_p, dim_t, size_a;
   unsigned n_layers, dim_lstm_in, dim_hidden;
 
+  /// The parameters of merge and scorer as column-major matrices, copied by
+  /// precompute(). Since merge is linear in each feature, W_k * encoded[i] is
+  /// computed once per sentence, and a transition is scored by adding four
+  /// precomputed columns, tanh and the scorer, outside the graph.
+  bool precomputed;
+  unsigned n_scores;
+  std::vector<float> merge_bias;
+  std::vector<float> merge_weights[4];
+  std::vector<float> scorer_bias;
+  std::vector<float> scorer_weights;
+  /// W_k * encoded[i] for each feature k and position i, the last position
+  /// being the empty feature. They are computed by the first predict_action
+  /// of a sentence, so the paths scoring in the graph don't pay for them.
+  bool features_ready;
+  std::vector<float> feature_values[4];
+  std::vector<float> hidden_values;
+  std::vector<float> score_values;
+
   explicit Kiperwasser16Model(dynet::ParameterCollection & m,
                                unsigned size_w,  //
                                unsigned dim_w,   // word size, word dim
@@ -90,7 +101,8 @@ struct Kiperwasser16Model : public ParseModel {
                                unsigned dim_lstm_in,
                                unsigned dim_hidden,
                                TransitionSystem& system,
-                               EmbeddingType embedding_type);
+                               EmbeddingType embedding_type,
+                               bool factorized = false);
 
   void new_graph(dynet::ComputationGraph& cg) override;
 
@@ -109,8 +121,21 @@ struct Kiperwasser16Model : public ParseModel {
 
   void destropy_checkpoint(StateCheckpoint * checkpoint) override;
 
-  /// Get the un-softmaxed scores from the LSTM-parser.
-  dynet::Expression get_scores(StateCheckpoint * checkpoint) override;
+  dynet::Expression get_hidden(StateCheckpoint * checkpoint) override;
+
+  dynet::Expression get_scorer_output(const dynet::Expression & hidden) override;
+
+  unsigned predict_action(dynet::ComputationGraph & cg,
+                          StateCheckpoint * checkpoint,
+                          unsigned valid_mask) override;
+
+  void precompute() override;
+
+  /// Fill feature_values for the sentence of the last initialize_parser().
+  void compute_feature_values(dynet::ComputationGraph & cg);
+
+  /// The encoding at the position, or the empty feature.
+  dynet::Expression get_feature(unsigned position);
 
   dynet::Expression l2() override;
 };
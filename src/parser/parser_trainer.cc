@@ -3,6 +3,7 @@
 #include "twpipe/logging.h"
 #include "twpipe/alphabet_collection.h"
 #include "twpipe/model.h"
+#include "twpipe/parallel.h"
 #include "twpipe/json.hpp"
 #include <iostream>
 #include <fstream>
@@ -29,8 +30,9 @@ ParserTrainer::ParserTrainer(ParseModel & engine,
 }
 
 float ParserTrainer::evaluate(Corpus & corpus) {
-  float n_recall = 0.f, n_total = 0.f;
-  for (unsigned sid = 0; sid < corpus.n_devel; ++sid) {
+  // counts[0] is the number of correct (head, deprel), counts[1] is the number of words.
+  std::vector<float> counts;
+  ParallelUtils::sum_counts(corpus.n_devel, evaluate_workers, 2, [&](unsigned sid, float * sums) {
     const Instance & inst = corpus.devel_data.at(sid);
 
     unsigned len = inst.input_units.size();
@@ -48,12 +50,12 @@ float ParserTrainer::evaluate(Corpus & corpus) {
     for (unsigned i = 0; i < pred_heads.size(); ++i) {
       if (gold_heads[i] == pred_heads[i] &&
           gold_deprels[i] == pred_deprels[i]) {
-        n_recall += 1.;
+        sums[0] += 1.;
       }
-      n_total += 1.;
+      sums[1] += 1.;
     }
-  }
-  float las = n_recall / n_total;
+  }, counts);
+  float las = counts[0] / counts[1];
   return las;
 }
 
@@ -64,6 +66,8 @@ po::options_description SupervisedTrainer::get_options() {
     ("parse-supervised-objective", po::value<std::string>()->default_value("crossentropy"), "The learning objective [crossentropy|rank|bipartie_rank|structure]")
     ("parse-supervised-do-pretrain-iter", po::value<unsigned>()->default_value(1), "The number of pretrain iteration on dynamic oracle.")
     ("parse-supervised-do-explore-prob", po::value<float>()->default_value(0.9), "The probability of exploration.")
+    ("parse-workers", po::value<unsigned>()->default_value(1), "The number of forked workers whose parameters are averaged.")
+    ("parse-sync-size", po::value<unsigned>()->default_value(0), "The number of sentences between two averages, 0 for once per iteration.")
     ;
   return cmd;
 }
@@ -108,6 +112,20 @@ SupervisedTrainer::SupervisedTrainer(ParseModel & engine,
 
   beam_size = (conf.count("parse-beam-size") ? conf["parse-beam-size"].as<unsigned>() : 0);
   allow_nonprojective = (conf["parse-system"].as<std::string>() == "swap");
+
+  n_workers = (conf.count("parse-workers") ? conf["parse-workers"].as<unsigned>() : 1);
+  if (n_workers == 0) { n_workers = 1; }
+  sync_size = (conf.count("parse-sync-size") ? conf["parse-sync-size"].as<unsigned>() : 0);
+  if (n_workers > 1 && opt_builder.is_stateful()) {
+    // only the parameters are averaged, the states of the optimizer would
+    // be reset to the parent's ones every round.
+    _ERROR << "[parse|train] parse-workers > 1 only supports the simple_sgd optimizer.";
+    exit(1);
+  }
+  if (n_workers > 1) {
+    _INFO << "[parse|train] train with " << n_workers << " workers, averaged every "
+      << (sync_size > 0 ? std::to_string(sync_size) + " sentences." : std::string("iteration."));
+  }
 }
 
 void SupervisedTrainer::train(Corpus& corpus) {
@@ -129,24 +147,32 @@ void SupervisedTrainer::train(Corpus& corpus) {
   for (unsigned iter = 1; iter <= max_iter; ++iter) {
     llh = 0;
     _INFO << "[parse|train] start training iteration #" << iter << ", shuffled.";
-    std::shuffle(order.begin(), order.end(), (*dynet::rndeng));
-
-    for (unsigned sid : order) {
-      InputUnits& input_units = corpus.training_data[sid].input_units;
-      const ParseUnits& parse_units = corpus.training_data[sid].parse_units;
-
-      noisifier.noisify(input_units);
-      float lp;
-      if (objective_type == kStructure) {
-        lp = train_structure_full_tree(input_units, parse_units, trainer, beam_size);
+    shuffle(corpus, order);
+
+    // with multiple workers, a round is dealt out round-robin to the workers,
+    // each of which trains on its shard in batches before the average.
+    unsigned round_size = (sync_size > 0 ? sync_size : order.size());
+    for (unsigned begin = 0, end = 0; begin < order.size(); begin = end) {
+      end = (n_workers > 1 ? std::min<unsigned>(order.size(), begin + round_size) :
+             next_batch_end(begin, order.size()));
+      if (n_workers > 1) {
+        llh += ParallelUtils::mix_parameters(engine.model, n_workers, [&](unsigned worker_id) {
+          std::vector<unsigned> shard;
+          for (unsigned i = begin + worker_id; i < end; i += n_workers) { shard.push_back(order[i]); }
+          float l = 0.f;
+          for (unsigned b = 0; b < shard.size(); b += batch_size) {
+            l += train_batch(corpus, noisifier, shard, b,
+                             std::min<unsigned>(shard.size(), b + batch_size), trainer, iter);
+          }
+          return l;
+        });
       } else {
-        lp = train_full_tree(input_units, parse_units, trainer, iter);
+        llh += train_batch(corpus, noisifier, order, begin, end, trainer, iter);
       }
-      llh += lp;
-      noisifier.denoisify(input_units);
-      
-      n_processed++;
-      if (need_evaluate(iter, n_processed)) {
+
+      unsigned n_before = n_processed;
+      n_processed += (end - begin);
+      if (need_evaluate(iter, n_before, n_processed)) {
         float las = evaluate(corpus);
         float prop = static_cast<float>(n_processed) / order.size();
         if (las > best_las) {
@@ -178,6 +204,40 @@ void SupervisedTrainer::train(Corpus& corpus) {
   delete trainer;
 }
 
+float SupervisedTrainer::train_batch(Corpus & corpus,
+                                     const Noisifier & noisifier,
+                                     const std::vector<unsigned> & order,
+                                     unsigned begin,
+                                     unsigned end,
+                                     dynet::Trainer * trainer,
+                                     unsigned iter) {
+  dynet::ComputationGraph cg;
+  engine.new_graph(cg);
+  std::vector<dynet::Expression> batch_loss;
+  float l2_coef = 0.f;
+  for (unsigned i = begin; i < end; ++i) {
+    InputUnits& input_units = corpus.training_data[order[i]].input_units;
+    const ParseUnits& parse_units = corpus.training_data[order[i]].parse_units;
+
+    noisifier.noisify(input_units);
+    if (objective_type == kStructure) {
+      train_structure_full_tree(cg, input_units, parse_units, beam_size, batch_loss);
+    } else {
+      train_full_tree(cg, input_units, parse_units, iter, batch_loss, l2_coef);
+    }
+    noisifier.denoisify(input_units);
+  }
+  float ret = 0.f;
+  if (!batch_loss.empty()) {
+    if (l2_coef > 0.f) { batch_loss.push_back(l2_coef * engine.l2()); }
+    dynet::Expression l = dynet::sum(batch_loss);
+    ret = dynet::as_scalar(cg.forward(l));
+    cg.backward(l);
+    trainer->update();
+  }
+  return ret;
+}
+
 void SupervisedTrainer::add_loss_one_step(dynet::Expression & score_expr,
                                           const unsigned & best_gold_action,
                                           const unsigned & worst_gold_action,
@@ -205,17 +265,17 @@ void SupervisedTrainer::add_loss_one_step(dynet::Expression & score_expr,
   }
 }
 
-float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
-                                         const ParseUnits& parse_units,
-                                         dynet::Trainer* trainer,
-                                         unsigned iter) {
+void SupervisedTrainer::train_full_tree(dynet::ComputationGraph & cg,
+                                        const InputUnits& input_units,
+                                        const ParseUnits& parse_units,
+                                        unsigned iter,
+                                        std::vector<dynet::Expression> & batch_loss,
+                                        float & l2_coef) {
   TransitionSystem & sys = engine.sys;
 
   std::vector<unsigned> ref_heads, ref_deprels;
   Corpus::parse_units_to_vector(parse_units, ref_heads, ref_deprels);
 
-  dynet::ComputationGraph cg;
-  engine.new_graph(cg);
   std::vector<dynet::Expression> loss;
   std::vector<unsigned> gold_actions;
   sys.get_oracle_actions(ref_heads, ref_deprels, gold_actions);
@@ -226,13 +286,17 @@ float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
   engine.initialize(cg, input_units, state, checkpoint);
   unsigned illegal_action = sys.num_actions();
   unsigned n_actions = 0;
+  std::vector<unsigned> valid_actions;
+  // the static cross-entropy loss does not read the scores, so the graph of
+  // the whole batch is left to be forwarded once by the caller.
+  bool need_scores = (oracle_type == kDynamic ||
+                      objective_type == kRank || objective_type == kBipartieRank);
+  std::vector<float> scores;
   while (!state.terminated()) {
-    // collect all valid actions.
-    std::vector<unsigned> valid_actions;
-    sys.get_valid_actions(state, valid_actions);
+    unsigned valid_mask = sys.get_valid_mask(state);
 
     dynet::Expression score_exprs = engine.get_scores(checkpoint);
-    std::vector<float> scores = dynet::as_vector(cg.get_value(score_exprs));
+    if (need_scores) { scores = dynet::as_vector(cg.get_value(score_exprs)); }
     unsigned action = 0;
 
     unsigned best_gold_action = illegal_action;
@@ -240,8 +304,10 @@ float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
     unsigned best_non_gold_action = illegal_action;
 
     if (oracle_type == kDynamic) {
-      auto payload = ParseModel::get_best_action(scores, valid_actions);
+      auto payload = sys.get_best_action(scores, valid_mask);
       action = payload.first;
+      // the costs are computed on the list of valid actions.
+      sys.get_valid_actions(state, valid_actions);
       std::vector<float> costs; // the larger, the better
       sys.get_transition_costs(state, valid_actions, ref_heads, ref_deprels, costs);
       float gold_action_cost = (*std::max_element(costs.begin(), costs.end()));
@@ -268,8 +334,8 @@ float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
       action = gold_actions[n_actions];
       if (objective_type == kRank || objective_type == kBipartieRank) {
         float best_non_gold_action_score = -1e10f;
-        for (unsigned i = 0; i < valid_actions.size(); ++i) {
-          unsigned act = valid_actions[i];
+        for (unsigned act = 0; act < scores.size(); ++act) {
+          if (!sys.is_valid_in(valid_mask, act)) { continue; }
           if (act != best_gold_action && (scores[act] > best_non_gold_action_score)) {
             best_non_gold_action = act;
             best_non_gold_action_score = scores[act];
@@ -288,26 +354,20 @@ float SupervisedTrainer::train_full_tree(const InputUnits& input_units,
     n_actions++;
   }
   engine.destropy_checkpoint(checkpoint);
-  float ret = 0.f;
   if (!loss.empty()) {
-    dynet::Expression l = dynet::sum(loss) + (0.5f * lambda_ * loss.size()) * engine.l2();
-    ret = dynet::as_scalar(cg.forward(l));
-    cg.backward(l);
-    trainer->update();
+    batch_loss.push_back(dynet::sum(loss));
+    l2_coef += 0.5f * lambda_ * loss.size();
   }
-  return ret;
 }
 
-float SupervisedTrainer::train_structure_full_tree(const InputUnits & input_units,
-                                                   const ParseUnits & parse_units,
-                                                   dynet::Trainer * trainer,
-                                                   unsigned beam_size) {
+void SupervisedTrainer::train_structure_full_tree(dynet::ComputationGraph & cg,
+                                                  const InputUnits & input_units,
+                                                  const ParseUnits & parse_units,
+                                                  unsigned beam_size,
+                                                  std::vector<dynet::Expression> & batch_loss) {
   typedef std::tuple<unsigned, unsigned, float, dynet::Expression> Transition;
   TransitionSystem & sys = engine.sys;
 
-  dynet::ComputationGraph cg;
-  engine.new_graph(cg);
-
   std::vector<unsigned> gold_heads, gold_deprels, gold_actions;
   Corpus::parse_units_to_vector(parse_units, gold_heads, gold_deprels);
   sys.get_oracle_actions(gold_heads, gold_deprels, gold_actions);
@@ -342,12 +402,12 @@ float SupervisedTrainer::train_structure_full_tree(const InputUnits & input_unit
         ));
       } else {
         ParseModel::StateCheckpoint * checkpoint = checkpoints[i];
-        std::vector<unsigned> valid_actions;
-        sys.get_valid_actions(prev_state, valid_actions);
+        unsigned valid_mask = sys.get_valid_mask(prev_state);
 
         dynet::Expression transit_scores_expr = engine.get_scores(checkpoint);
         std::vector<float> transit_scores = dynet::as_vector(cg.get_value(transit_scores_expr));
-        for (unsigned a : valid_actions) {
+        for (unsigned a = 0; a < transit_scores.size(); ++a) {
+          if (!sys.is_valid_in(valid_mask, a)) { continue; }
           transitions.push_back(std::make_tuple(
             i, a, prev_score + transit_scores[a],
             prev_score_expr + dynet::pick(transit_scores_expr, a)
@@ -401,11 +461,7 @@ float SupervisedTrainer::train_structure_full_tree(const InputUnits & input_unit
   for (unsigned i = curr; i < next; ++i) {
     loss.push_back(scores_exprs[i]);
   }
-  dynet::Expression l = dynet::pickneglogsoftmax(dynet::concatenate(loss), corr - curr);
-  float ret = dynet::as_scalar(cg.forward(l));
-  cg.backward(l);
-  trainer->update();
-  return ret;
+  batch_loss.push_back(dynet::pickneglogsoftmax(dynet::concatenate(loss), corr - curr));
 }
 
 void SupervisedTrainer::get_orders(Corpus& corpus,
@@ -452,7 +508,7 @@ void SupervisedEnsembleTrainer::train(Corpus & corpus,
   // bool allow_nonprojective = engine.sys.allow_nonprojective();
   for (unsigned i = 0; i < ensemble_instances.size(); ++i) {
     unsigned id = ensemble_instances[i].id;
-    if (corpus.training_data.count(id) == 0) { continue; }
+    if (id >= corpus.training_data.size()) { continue; }
     order.push_back(i);
   }
 
@@ -526,9 +582,6 @@ float SupervisedEnsembleTrainer::train_full_tree(const InputUnits & input_units,
 
   unsigned n_actions = 0;
   while (!state.terminated()) {
-    std::vector<unsigned> valid_actions;
-    sys.get_valid_actions(state, valid_actions);
-
     dynet::Expression score_expr = engine.get_scores(checkpoint);
     unsigned action = actions[n_actions];
     const std::vector<float> & prob = probs[n_actions];
@@ -39,6 +39,8 @@ struct SupervisedTrainer : public ParserTrainer {
   float do_explore_prob;
   unsigned beam_size;
   bool allow_nonprojective;
+  unsigned n_workers;
+  unsigned sync_size;
 
   static po::options_description get_options();
 
@@ -49,15 +51,30 @@ struct SupervisedTrainer : public ParserTrainer {
   /* Code for supervised pretraining. */
   void train(Corpus& corpus);
 
-  float train_full_tree(const InputUnits& input_units,
-                        const ParseUnits& parse_units,
-                        dynet::Trainer* trainer,
-                        unsigned iter);
-
-  float train_structure_full_tree(const InputUnits & input_units,
-                                  const ParseUnits & parse_units,
-                                  dynet::Trainer * trainer,
-                                  unsigned beam_size);
+  /* Train on the sentences order[begin, end) with one update, return the loss. */
+  float train_batch(Corpus & corpus,
+                    const Noisifier & noisifier,
+                    const std::vector<unsigned> & order,
+                    unsigned begin,
+                    unsigned end,
+                    dynet::Trainer * trainer,
+                    unsigned iter);
+
+  /* Build the loss of one sentence on cg and push it to batch_loss, the
+     update is left to the caller. The coefficient of the l2 term of the
+     sentence is added to l2_coef, so the batch builds l2 only once. */
+  void train_full_tree(dynet::ComputationGraph & cg,
+                       const InputUnits& input_units,
+                       const ParseUnits& parse_units,
+                       unsigned iter,
+                       std::vector<dynet::Expression> & batch_loss,
+                       float & l2_coef);
+
+  void train_structure_full_tree(dynet::ComputationGraph & cg,
+                                 const InputUnits & input_units,
+                                 const ParseUnits & parse_units,
+                                 unsigned beam_size,
+                                 std::vector<dynet::Expression> & batch_loss);
 
   void add_loss_one_step(dynet::Expression & score_expr,
                          const unsigned & best_gold_action,
@@ -0,0 +1,66 @@
+#ifndef __TWPIPE_PARSER_PERSISTENT_STACK_H__
+#define __TWPIPE_PARSER_PERSISTENT_STACK_H__
+
+#include <memory>
+#include <boost/assert.hpp>
+
+namespace twpipe {
+
+/**
+ * A stack whose nodes are linked to their parents and shared between the
+ * copies, so copying is O(1) and pushing onto a copy leaves the others
+ * untouched. It keeps the part of the std::vector interface used by the
+ * parser checkpoints; operator[] is indexed from the bottom and walks from
+ * the top, so it is only cheap near the top.
+ */
+template <class T>
+struct PersistentStack {
+  struct Node {
+    T value;
+    std::shared_ptr<const Node> parent;
+
+    Node(const T & value, const std::shared_ptr<const Node> & parent) :
+      value(value), parent(parent) {}
+  };
+
+  std::shared_ptr<const Node> top;
+  unsigned n;
+
+  PersistentStack() : n(0) {}
+
+  void push_back(const T & value) {
+    top = std::make_shared<const Node>(value, top);
+    ++n;
+  }
+
+  void pop_back() {
+    BOOST_ASSERT_MSG(n > 0, "[parse|stack] pop from an empty stack.");
+    top = top->parent;
+    --n;
+  }
+
+  const T & back() const {
+    BOOST_ASSERT_MSG(n > 0, "[parse|stack] back of an empty stack.");
+    return top->value;
+  }
+
+  const T & operator[](unsigned i) const {
+    BOOST_ASSERT_MSG(i < n, "[parse|stack] index out of range.");
+    const Node * node = top.get();
+    for (unsigned k = n - 1; k > i; --k) { node = node->parent.get(); }
+    return node->value;
+  }
+
+  unsigned size() const { return n; }
+
+  bool empty() const { return n == 0; }
+
+  void clear() {
+    top.reset();
+    n = 0;
+  }
+};
+
+}
+
+#endif  //  end for __TWPIPE_PARSER_PERSISTENT_STACK_H__
@@ -71,15 +71,16 @@ void VanillaSampler::sample(const std::vector<std::string> &words,
   engine->initialize_parser(cg, input, checkpoint);
 
   unsigned n_actions = 0;
+  std::vector<unsigned> valid_actions;
+  std::vector<float> valid_prob;
   while (!state.terminated()) {
-    std::vector<unsigned> valid_actions;
     system.get_valid_actions(state, valid_actions);
 
     dynet::Expression score_exprs = engine->get_scores(checkpoint);
     std::vector<float> probs = dynet::as_vector(cg.get_value(score_exprs));
     Math::softmax_inplace(probs);
 
-    std::vector<float> valid_prob;
+    valid_prob.clear();
     for (unsigned act : valid_actions) {
       valid_prob.push_back(log(probs[act]));
     }
@@ -131,8 +132,9 @@ void EnsembleSampler::sample(const std::vector<std::string> &words,
   }
 
   unsigned n_actions = 0;
+  std::vector<unsigned> valid_actions;
+  std::vector<float> valid_prob;
   while (!state.terminated()) {
-    std::vector<unsigned> valid_actions;
     system.get_valid_actions(state, valid_actions);
 
     std::vector<float> ensemble_probs(system.num_actions(), 0.f);
@@ -146,7 +148,7 @@ void EnsembleSampler::sample(const std::vector<std::string> &words,
     }
     for (auto & p : ensemble_probs) { p /= n_engines; }
 
-    std::vector<float> valid_prob;
+    valid_prob.clear();
     for (unsigned act : valid_actions) {
       valid_prob.push_back(log(ensemble_probs[act]));
     }
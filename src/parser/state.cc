@@ -1,10 +1,50 @@
 #include "state.h"
-#include "twpipe/corpus.h"
-#include <boost/assert.hpp>
+#include <cstring>
 
 namespace twpipe {
 
-State::State(unsigned n) : heads(n, Corpus::BAD_HED), deprels(n, Corpus::BAD_DEL) {
+State::State(unsigned n) : n_words(0) {
+  allocate(n);
+  heads.resize(n, Corpus::BAD_HED);
+  deprels.resize(n, Corpus::BAD_DEL);
+}
+
+State::State(const State & other) : n_words(0) {
+  allocate(other.n_words);
+  copy_from(other);
+}
+
+State & State::operator=(const State & other) {
+  if (this != &other) {
+    if (n_words != other.n_words) { allocate(other.n_words); }
+    copy_from(other);
+  }
+  return (*this);
+}
+
+void State::allocate(unsigned n) {
+  n_words = n;
+  unsigned * cells = inline_cells;
+  heap_cells.reset();
+  if (n > N_INLINE_WORDS) {
+    heap_cells.reset(new unsigned[4 * n + 2]);
+    cells = heap_cells.get();
+  }
+  heads.data = cells;               heads.capacity = n;       heads.n = 0;
+  deprels.data = heads.data + n;    deprels.capacity = n;     deprels.n = 0;
+  stack.data = deprels.data + n;    stack.capacity = n + 1;   stack.n = 0;
+  buffer.data = stack.data + n + 1; buffer.capacity = n + 1;  buffer.n = 0;
+}
+
+void State::copy_from(const State & other) {
+  // only the used part of the stack and buffer is copied.
+  std::memcpy(heads.data, other.heads.data, 2 * n_words * sizeof(unsigned));
+  std::memcpy(stack.data, other.stack.data, other.stack.n * sizeof(unsigned));
+  std::memcpy(buffer.data, other.buffer.data, other.buffer.n * sizeof(unsigned));
+  heads.n = other.heads.n;
+  deprels.n = other.deprels.n;
+  stack.n = other.stack.n;
+  buffer.n = other.buffer.n;
 }
 
 float State::loss(const std::vector<unsigned>& gold_heads,
@@ -26,4 +66,10 @@ bool State::terminated() const {
   return !(stack.size() > 2 || buffer.size() > 1);
 }
 
-}
\ No newline at end of file
+void State::to_parse_units(ParseUnits & parse) const {
+  Corpus::vector_to_parse_units(std::vector<unsigned>(heads.begin(), heads.end()),
+                                std::vector<unsigned>(deprels.begin(), deprels.end()),
+                                parse);
+}
+
+}
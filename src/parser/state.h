@@ -2,27 +2,95 @@
 #define __TWPIPE_PARSER_STATE_H__
 
 #include <vector>
+#include <memory>
+#include <boost/assert.hpp>
+#include "twpipe/corpus.h"
 
 namespace twpipe {
 
+/**
+ * A fixed-capacity array of indices living in the cells of a State. It keeps
+ * the part of the std::vector interface used by the transition systems.
+ */
+struct StateArray {
+  unsigned * data;
+  unsigned n;
+  unsigned capacity;
+
+  StateArray() : data(nullptr), n(0), capacity(0) {}
+
+  void push_back(unsigned value) {
+    BOOST_ASSERT_MSG(n < capacity, "[parse|state] push to a full array.");
+    data[n++] = value;
+  }
+
+  void pop_back() {
+    BOOST_ASSERT_MSG(n > 0, "[parse|state] pop from an empty array.");
+    --n;
+  }
+
+  unsigned & back() { return data[n - 1]; }
+  const unsigned & back() const { return data[n - 1]; }
+
+  unsigned & operator[](unsigned i) { return data[i]; }
+  const unsigned & operator[](unsigned i) const { return data[i]; }
+
+  void resize(unsigned m, unsigned value = 0) {
+    BOOST_ASSERT_MSG(m <= capacity, "[parse|state] resize beyond the capacity.");
+    for (unsigned i = n; i < m; ++i) { data[i] = value; }
+    n = m;
+  }
+
+  unsigned size() const { return n; }
+  bool empty() const { return n == 0; }
+  void clear() { n = 0; }
+
+  const unsigned * begin() const { return data; }
+  const unsigned * end() const { return data + n; }
+};
+
+/**
+ * The stack, buffer, heads and deprels of a state share one block of cells,
+ * which is inline for sentences of up to N_INLINE_WORDS words, so building
+ * and copying a state in the search and the oracles does not touch the heap
+ * for most of the sentences.
+ */
 struct State {
   static const unsigned MAX_N_WORDS = 1024;
+  static const unsigned N_INLINE_WORDS = 64;
 
-  std::vector<unsigned> stack;
-  std::vector<unsigned> buffer;
-  std::vector<unsigned> heads;
-  std::vector<unsigned> deprels;
-  // std::vector<unsigned> aux;
+  StateArray stack;
+  StateArray buffer;
+  StateArray heads;
+  StateArray deprels;
 
   State(unsigned n);
 
+  State(const State & other);
+
+  State & operator=(const State & other);
+
   //! Computing the loss on the current state and reference.
   float loss(const std::vector<unsigned>& gold_heads,
              const std::vector<unsigned>& gold_deprels);
 
   bool terminated() const;
+
+  void to_parse_units(ParseUnits & parse) const;
+
+private:
+  // heads and deprels hold n words, stack and buffer hold n words and a guard.
+  static const unsigned N_INLINE_CELLS = 4 * N_INLINE_WORDS + 2;
+
+  unsigned n_words;
+  unsigned inline_cells[N_INLINE_CELLS];
+  std::unique_ptr<unsigned[]> heap_cells;
+
+  void allocate(unsigned n);
+
+  void copy_from(const State & other);
 };
 
 }
 
-#endif  //  end for STATE_H
\ No newline at end of file
+#endif  //  end for STATE_H
@@ -15,6 +15,9 @@ Swap::Swap() : TransitionSystem() {
     action_names.push_back("LEFT-" + map.get(i));
     action_names.push_back("RIGHT-" + map.get(i));
   }
+  for (unsigned a = 0; a < n_actions; ++a) {
+    action_classes.push_back(is_shift(a) ? kShift : (is_swap(a) ? kSwap : (is_left(a) ? kLeft : kRight)));
+  }
   _INFO << "TransitionSystem:: show action names:";
   for (const auto& action_name : action_names) {
     _INFO << "- " << action_name;
@@ -321,32 +324,17 @@ unsigned Swap::parse_label(const unsigned & action) const {
   return (action % 2 == 0 ? (action - 2) / 2 : (action - 3) / 2);
 }
 
-void Swap::get_valid_actions(const State & state,
-                             std::vector<unsigned>& valid_actions) {
-  valid_actions.clear();
-  for (unsigned a = 0; a < n_actions; ++a) {
-    //if (!is_valid_action(state, action_names[a])) { continue; }
-    if (!is_valid_action(state, a)) { continue; }
-    valid_actions.push_back(a);
-  }
-  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
-}
-
-bool Swap::is_valid_action(const State& state, const unsigned& act) const {
-  bool is_shift = (act == 0);
-  bool is_swap = (act == 1);
-  bool is_reduce = (!is_shift && !is_swap);
-
-  if (is_shift && state.buffer.size() == 1) { return false; }
-  if (is_swap && (state.stack.size() < 3 || state.buffer.size() == 1)) { return false; }
-  if (is_swap && state.stack[state.stack.size() - 2] > state.stack.back()) { return false; }
-  if (is_reduce) {
-    if (state.stack.size() < 3) { return false; }
-    if (is_left(act) && state.stack[state.stack.size() - 2] == 0) { return false; }
+unsigned Swap::get_valid_mask(const State& state) const {
+  unsigned mask = 0;
+  if (state.buffer.size() > 1) { mask |= (1 << kShift); }
+  if (state.stack.size() >= 3) {
+    mask |= (1 << kRight);
+    if (state.stack[state.stack.size() - 2] != 0) { mask |= (1 << kLeft); }
+    if (state.buffer.size() > 1 && state.stack[state.stack.size() - 2] <= state.stack.back()) {
+      mask |= (1 << kSwap);
+    }
   }
-  // if (is_reduce && state.stack.size() < 3) { return false; }
-  // if (state.buffer.size() == 1 && !is_right(act)) { return false; }
-  return true;
+  return mask;
 }
 
 }
\ No newline at end of file
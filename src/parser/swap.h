@@ -30,14 +30,11 @@ struct Swap : public TransitionSystem {
 
   void perform_action(State& state, const unsigned& action) override;
 
-  void get_valid_actions(const State& state,
-                         std::vector<unsigned>& valid_actions) override;
-
   void get_oracle_actions(const std::vector<unsigned>& heads,
                           const std::vector<unsigned>& deprels,
                           std::vector<unsigned>& actions) override;
 
-  bool is_valid_action(const State& state, const unsigned& act) const override;
+  unsigned get_valid_mask(const State& state) const override;
 
   void get_oracle_actions_calculate_orders(const unsigned & root,
                                            const std::vector<std::vector<unsigned>>& tree,
@@ -1,10 +1,41 @@
 #include "system.h"
 #include "twpipe/alphabet_collection.h"
+#include <climits>
+#include <boost/assert.hpp>
 
 namespace twpipe {
 
-unsigned TransitionSystem::num_deprels() {
+unsigned TransitionSystem::num_deprels() const {
   return AlphabetCollection::get()->deprel_map.size();
 }
 
+bool TransitionSystem::is_valid_action(const State& state, const unsigned& act) const {
+  return is_valid_in(get_valid_mask(state), act);
+}
+
+void TransitionSystem::get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) const {
+  unsigned mask = get_valid_mask(state);
+  valid_actions.clear();
+  for (unsigned a = 0; a < action_classes.size(); ++a) {
+    if (is_valid_in(mask, a)) { valid_actions.push_back(a); }
+  }
+  BOOST_ASSERT_MSG(valid_actions.size() > 0, "There should be one or more valid action.");
+}
+
+std::pair<unsigned, float> TransitionSystem::get_best_action(const std::vector<float>& scores,
+                                                             const unsigned& mask) const {
+  unsigned best_a = UINT_MAX;
+  float best_score = 0.f;
+  const unsigned * classes = action_classes.data();
+  for (unsigned a = 0; a < action_classes.size(); ++a) {
+    if (((mask >> classes[a]) & 1) == 0) { continue; }
+    if (best_a == UINT_MAX || best_score < scores[a]) {
+      best_a = a;
+      best_score = scores[a];
+    }
+  }
+  BOOST_ASSERT_MSG(best_a != UINT_MAX, "There should be one or more valid action.");
+  return std::make_pair(best_a, best_score);
+}
+
 }
@@ -8,6 +8,14 @@
 namespace twpipe {
 
 struct TransitionSystem {
+  /// The validity of an action only depends on its class, so the valid
+  /// actions of a state are given by a mask of classes, bit c for class c.
+  enum ACTION_CLASS { kShift, kLeft, kRight, kReduce, kSwap };
+  static const unsigned N_ACTION_CLASSES = 5;
+
+  /// The class of each action, filled by the constructor of the system.
+  std::vector<unsigned> action_classes;
+
   TransitionSystem() {}
 
   /// Get the name of transition system.
@@ -20,7 +28,7 @@ struct TransitionSystem {
 
   virtual unsigned num_actions() const = 0;
 
-  unsigned num_deprels();
+  unsigned num_deprels() const;
 
   virtual void get_transition_costs(const State& state,
                                     const std::vector<unsigned>& actions,
@@ -30,9 +38,20 @@ struct TransitionSystem {
 
   virtual void perform_action(State& state, const unsigned& action) = 0;
 
-  virtual bool is_valid_action(const State& state, const unsigned& act) const = 0;
+  /// Get the mask of the valid action classes on the state.
+  virtual unsigned get_valid_mask(const State& state) const = 0;
+
+  bool is_valid_action(const State& state, const unsigned& act) const;
+
+  bool is_valid_in(const unsigned& mask, const unsigned& act) const {
+    return ((mask >> action_classes[act]) & 1) != 0;
+  }
+
+  void get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) const;
 
-  virtual void get_valid_actions(const State& state, std::vector<unsigned>& valid_actions) = 0;
+  /// Get the valid action of the highest score and its score.
+  std::pair<unsigned, float> get_best_action(const std::vector<float>& scores,
+                                             const unsigned& mask) const;
 
   virtual void get_oracle_actions(const std::vector<unsigned>& heads,
                                   const std::vector<unsigned>& deprels,
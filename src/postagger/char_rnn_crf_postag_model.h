@@ -6,6 +6,7 @@
 #include "twpipe/embedding.h"
 #include "twpipe/alphabet_collection.h"
 #include "twpipe/corpus.h"
+#include "twpipe/math.h"
 #include "dynet/gru.h"
 #include "dynet/lstm.h"
 #include "dynet_layer/layer.h"
@@ -14,14 +15,12 @@ namespace twpipe {
 
 template <class RNNBuilderType>
 struct CharacterRNNCRFPostagModel : public PostagModel {
-  typedef std::vector<dynet::Expression> ExpressionRow;
   const static char* name;
   BiRNNLayer<RNNBuilderType> char_rnn;
   BiRNNLayer<RNNBuilderType> word_rnn;
   SymbolEmbedding char_embed;
   SymbolEmbedding pos_embed;
   SymbolEmbedding tran_embed;
-  InputLayer embed_input;
   DenseLayer dense1;
   DenseLayer dense2;
 
@@ -34,6 +33,9 @@ struct CharacterRNNCRFPostagModel : public PostagModel {
   unsigned word_n_layers;
   unsigned pos_dim;
   unsigned root_pos_id;
+  std::vector<unsigned> tran_ids;
+  // the transition block read by precompute(), empty while training.
+  std::vector<float> frozen_tran;
 
   CharacterRNNCRFPostagModel(dynet::ParameterCollection & model,
                              unsigned char_size,
@@ -51,7 +53,6 @@ struct CharacterRNNCRFPostagModel : public PostagModel {
     char_embed(model, char_size, char_dim),
     pos_embed(model, AlphabetCollection::get()->pos_map.size(), pos_dim),
     tran_embed(model, AlphabetCollection::get()->pos_map.size() * AlphabetCollection::get()->pos_map.size(), 1),
-    embed_input(embed_dim),
     dense1(model, word_hidden_dim + word_hidden_dim + pos_dim, word_hidden_dim),
     dense2(model, word_hidden_dim, 1),
     char_size(char_size),
@@ -72,6 +73,8 @@ struct CharacterRNNCRFPostagModel : public PostagModel {
     _INFO << "[postag|model] postag hidden dimension = " << pos_dim;
 
     root_pos_id = AlphabetCollection::get()->pos_map.get(Corpus::ROOT);
+    tran_ids.resize(pos_size * pos_size);
+    for (unsigned k = 0; k < tran_ids.size(); ++k) { tran_ids[k] = k; }
   }
 
   void new_graph(dynet::ComputationGraph & cg) override {
@@ -80,43 +83,35 @@ struct CharacterRNNCRFPostagModel : public PostagModel {
     char_embed.new_graph(cg);
     pos_embed.new_graph(cg);
     tran_embed.new_graph(cg);
-    embed_input.new_graph(cg);
     dense1.new_graph(cg);
     dense2.new_graph(cg);
   }
 
-  void initialize(const std::vector<std::string> & words) override {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
+  unsigned get_char_encoding_dim() override { return char_hidden_dim + char_hidden_dim; }
 
-    std::vector<std::vector<float>> embeddings;
-    if (embedding_type_ == kStaticEmbeddings) {
-      WordEmbedding::get()->render(words, embeddings);
-    } else {
-      ELMo::get()->render(words, embeddings);
+  dynet::Expression get_char_encoding(const std::vector<unsigned> & cids) override {
+    unsigned n_chars = cids.size();
+    std::vector<dynet::Expression> char_exprs(n_chars);
+    for (unsigned j = 0; j < n_chars; ++j) {
+      char_exprs[j] = char_embed.embed(cids[j]);
     }
+    char_rnn.add_inputs(char_exprs);
+    auto payload = char_rnn.get_final();
+    return dynet::concatenate({ payload.first, payload.second });
+  }
+
+  void initialize(const std::vector<std::string> & words) override {
+    std::vector<dynet::Expression> embeddings;
+    get_embeddings(*char_embed.cg, words, embeddings);
 
     unsigned n_words = words.size();
     std::vector<dynet::Expression> word_reprs(n_words);
 
-    for (unsigned i = 0; i < n_words; ++i) {
-      std::string word = words[i];
-      unsigned len = 0;
-      std::vector<unsigned> cids;
-      for (unsigned j = 0; j < word.size(); j += len) {
-        len = utf8_len(word[j]);
-        std::string ch = word.substr(j, len);
-        unsigned cid = (char_map.contains(ch) ? char_map.get(ch) : char_map.get(Corpus::UNK));
-        cids.push_back(cid);
-      }
+    std::vector<dynet::Expression> char_encodings;
+    get_char_encodings(*char_embed.cg, words, char_encodings);
 
-      unsigned n_chars = cids.size();
-      std::vector<dynet::Expression> char_exprs(n_chars);
-      for (unsigned j = 0; j < n_chars; ++j) {
-        char_exprs[j] = char_embed.embed(cids[j]);
-      }
-      char_rnn.add_inputs(char_exprs);
-      auto payload = char_rnn.get_final();
-      word_reprs[i] = dynet::concatenate({ payload.first, payload.second, embed_input.get_output(embeddings[i]) });
+    for (unsigned i = 0; i < n_words; ++i) {
+      word_reprs[i] = dynet::concatenate({ char_encodings[i], embeddings[i] });
     }
 
     word_rnn.add_inputs(word_reprs);
@@ -133,61 +128,96 @@ struct CharacterRNNCRFPostagModel : public PostagModel {
     return feature;
   }
 
+  void get_contexts(unsigned n_words,
+                    std::vector<dynet::Expression> & contexts) override {
+    contexts.resize(n_words);
+    for (unsigned i = 0; i < n_words; ++i) {
+      auto payload = word_rnn.get_output(i);
+      contexts[i] = dynet::concatenate({ payload.first, payload.second });
+    }
+  }
+
+  dynet::Expression get_feature(const dynet::Expression & context,
+                                unsigned prev_tag) override {
+    return dynet::concatenate({ context, pos_embed.embed(prev_tag) });
+  }
+
+  /// Emission scores of all the tags for all the words in the sentence of the
+  /// last initialize(), as a batch with element i * pos_size + t.
+  dynet::Expression get_emit_scores(unsigned n_words) {
+    std::vector<dynet::Expression> contexts;
+    get_contexts(n_words, contexts);
+
+    std::vector<dynet::Expression> tag_exprs(pos_size);
+    for (unsigned t = 0; t < pos_size; ++t) { tag_exprs[t] = pos_embed.embed(t); }
+    dynet::Expression all_tags = dynet::concatenate_to_batch(tag_exprs);
+
+    std::vector<dynet::Expression> features(n_words);
+    for (unsigned i = 0; i < n_words; ++i) {
+      dynet::Expression context = dynet::concatenate_to_batch(
+        std::vector<dynet::Expression>(pos_size, contexts[i]));
+      features[i] = dynet::concatenate({ context, all_tags });
+    }
+    dynet::Expression feature = dynet::concatenate_to_batch(features);
+    return get_emit_score(feature);
+  }
+
+  /// Transition scores as a pos_size x pos_size block, indexed by pt * pos_size + t.
+  /// The cells are read by one batched lookup and moved out of the batch.
+  dynet::Expression get_tran_scores() {
+    dynet::Expression cells = dynet::lookup(*tran_embed.cg, tran_embed.p_labels, tran_ids);
+    return dynet::reshape(cells, { pos_size * pos_size });
+  }
+
+  void precompute() override {
+    dynet::ComputationGraph cg;
+    new_graph(cg);
+    frozen_tran = dynet::as_vector(cg.forward(get_tran_scores()));
+  }
+
   void decode(const std::vector<std::string> & words, std::vector<std::string> & tags) override {
+    std::vector<std::vector<std::string>> batch_tags;
+    decode_batch({ words }, batch_tags);
+    tags.swap(batch_tags[0]);
+  }
+
+  void decode_batch(const std::vector<std::vector<std::string>> & batch,
+                    std::vector<std::vector<std::string>> & batch_tags) override {
     Alphabet & pos_map = AlphabetCollection::get()->pos_map;
 
-    unsigned n_words = words.size();
-    initialize(words);
-    std::vector<dynet::Expression> losses(n_words);
-    std::vector<std::vector<float>> emit_matrix(n_words, std::vector<float>(pos_size));
-    std::vector<std::vector<float>> tran_matrix(pos_size, std::vector<float>(pos_size));
-    for (unsigned t = 0; t < pos_size; ++t) {
-      for (unsigned pt = 0; pt < pos_size; ++pt) {
-        dynet::Expression tran_score = tran_embed.embed(pt * pos_size + t);
-        tran_matrix[pt][t] = dynet::as_scalar(tran_score.value());
-      }
+    unsigned n_sentences = batch.size();
+    std::vector<dynet::Expression> emit_exprs(n_sentences);
+    for (unsigned s = 0; s < n_sentences; ++s) {
+      if (batch[s].empty()) { continue; }
+      initialize(batch[s]);
+      emit_exprs[s] = get_emit_scores(batch[s].size());
     }
 
-    for (unsigned i = 0; i < n_words; ++i) {
-      for (unsigned t = 0; t < pos_size; ++t) {
-        dynet::Expression feature = get_feature(i, t);
-        dynet::Expression emit_score = get_emit_score(feature);
-        emit_matrix[i][t] = dynet::as_scalar(emit_score.value());
+    // the last node is forwarded first, which computes the emissions of the
+    // whole batch in one pass.
+    std::vector<float> tran;
+    if (frozen_tran.empty()) {
+      tran = dynet::as_vector(get_tran_scores().value());
+    } else {
+      for (unsigned s = n_sentences; s > 0; --s) {
+        if (batch[s - 1].empty()) { continue; }
+        emit_exprs[s - 1].pg->incremental_forward(emit_exprs[s - 1]);
+        break;
       }
     }
+    const std::vector<float> & tran_values = (frozen_tran.empty() ? tran : frozen_tran);
+    std::vector<unsigned> output;
 
-    std::vector<std::vector<float>> alpha(n_words, std::vector<float>(pos_size, -1e10f));
-    std::vector<std::vector<unsigned>> path(n_words, std::vector<unsigned>(pos_size, root_pos_id));
+    batch_tags.resize(n_sentences);
+    for (unsigned s = 0; s < n_sentences; ++s) {
+      unsigned n_words = batch[s].size();
+      batch_tags[s].resize(n_words);
+      if (n_words == 0) { continue; }
 
-    for (unsigned i = 0; i < n_words; ++i) {
-      for (unsigned t = 0; t < pos_size; ++t) {
-        if (i == 0) {
-          alpha[i][t] = emit_matrix[i][t] + tran_matrix[root_pos_id][t];
-          path[i][t] = root_pos_id;
-          continue;
-        }
-        alpha[i][t] = alpha[i - 1][0] + emit_matrix[i][t] + tran_matrix[0][t];
-        for (unsigned pt = 1; pt < pos_size; ++pt) {
-          float score = alpha[i - 1][pt] + emit_matrix[i][t] + tran_matrix[pt][t];
-          if (score > alpha[i][t]) {
-            alpha[i][t] = score;
-            path[i][t] = pt;
-          }
-        }
-      }
-    }
-    unsigned best = 0;
-    float best_score = alpha[n_words - 1][0];
-    for (unsigned t = 1; t < pos_size; ++t) {
-      if (best_score < alpha[n_words - 1][t]) { best = t; best_score = alpha[n_words - 1][t]; }
-    }
-    tags.clear();
-    tags.push_back(pos_map.get(best));
-    for (unsigned i = n_words - 1; i > 0; --i) {
-      best = path[i][best];
-      tags.push_back(pos_map.get(best));
+      std::vector<float> emit = dynet::as_vector(emit_exprs[s].value());
+      Math::viterbi(emit.data(), tran_values, n_words, pos_size, root_pos_id, output);
+      for (unsigned i = 0; i < n_words; ++i) { batch_tags[s][i] = pos_map.get(output[i]); }
     }
-    std::reverse(tags.begin(), tags.end());
   }
 
   dynet::Expression objective(const Instance & inst) override {
@@ -200,51 +230,30 @@ struct CharacterRNNCRFPostagModel : public PostagModel {
       labels[i - 1] = inst.input_units[i].pid;
     }
     initialize(words);
-    std::vector<dynet::Expression> losses(n_words);
 
-    std::vector<ExpressionRow> emit_matrix(n_words, ExpressionRow(pos_size));
-    std::vector<ExpressionRow> tran_matrix(pos_size, ExpressionRow(pos_size));
-    for (unsigned t = 0; t < pos_size; ++t) {
-      for (unsigned pt = 0; pt < pos_size; ++pt) {
-        tran_matrix[pt][t] = tran_embed.embed(pt * pos_size + t);
-      }
-    }
+    // column i of emit holds the scores of all the tags for the i-th word.
+    dynet::Expression emit = dynet::reshape(get_emit_scores(n_words), { pos_size, n_words });
+    dynet::Expression tran_vec = get_tran_scores();
+    // column pt of tran_by_prev holds the scores of moving from pt to each tag,
+    // tran is indexed by [pt][t].
+    dynet::Expression tran_by_prev = dynet::reshape(tran_vec, { pos_size, pos_size });
+    dynet::Expression tran = dynet::transpose(tran_by_prev);
 
-    for (unsigned i = 0; i < n_words; ++i) {
-      for (unsigned t = 0; t < pos_size; ++t) {
-        dynet::Expression feature = get_feature(i, t);
-        emit_matrix[i][t] = get_emit_score(feature);
-      }
+    // forward algorithm, alpha is a pos_size vector at each position.
+    dynet::Expression alpha = dynet::pick(emit, 0, 1) + dynet::pick(tran_by_prev, root_pos_id, 1);
+    for (unsigned i = 1; i < n_words; ++i) {
+      alpha = dynet::logsumexp_dim(dynet::colwise_add(tran, alpha), 0) + dynet::pick(emit, i, 1);
     }
 
-    std::vector<ExpressionRow> alpha(n_words, ExpressionRow(pos_size));
-    std::vector<dynet::Expression> path(n_words);
-
+    dynet::Expression emit_vec = dynet::reshape(emit, { pos_size * n_words });
+    std::vector<dynet::Expression> path(n_words * 2);
+    unsigned prev_label = root_pos_id;
     for (unsigned i = 0; i < n_words; ++i) {
-      for (unsigned t = 0; t < pos_size; ++t) {
-        std::vector<dynet::Expression> f;
-        if (i == 0) {
-          f.push_back(emit_matrix[i][t] + tran_matrix[root_pos_id][t]);
-          if (t == labels[i]) {
-            path[i] = emit_matrix[i][t] + tran_matrix[root_pos_id][t];
-          }
-        } else {
-          for (unsigned pt = 0; pt < pos_size; ++pt) {
-            f.push_back(alpha[i - 1][pt] + emit_matrix[i][t] + tran_matrix[pt][t]);
-            if (pt == labels[i - 1] && t == labels[i]) {
-              path[i] = path[i - 1] + emit_matrix[i][t] + tran_matrix[pt][t];
-            }
-          }
-        }
-        alpha[i][t] = dynet::logsumexp(f);
-      }
-    }
-
-    std::vector<dynet::Expression> f;
-    for (unsigned t = 0; t < pos_size; ++t) {
-      f.push_back(alpha[n_words - 1][t]);
+      path[i * 2] = dynet::pick(emit_vec, i * pos_size + labels[i]);
+      path[i * 2 + 1] = dynet::pick(tran_vec, prev_label * pos_size + labels[i]);
+      prev_label = labels[i];
     }
-    return dynet::logsumexp(f) - path.back();
+    return dynet::logsumexp_dim(alpha, 0) - dynet::sum(path);
   }
 
   dynet::Expression l2() override {
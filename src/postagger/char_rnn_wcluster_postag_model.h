@@ -21,7 +21,6 @@ struct CharacterRNNWithClusterPostagModel : public PostagModel {
   SymbolEmbedding char_embed;
   SymbolEmbedding pos_embed;
   SymbolEmbedding cluster_embed;
-  InputLayer embed_input;
   Merge3Layer merge;
   DenseLayer dense;
   dynet::Parameter p_unk_cluster;
@@ -58,7 +57,6 @@ struct CharacterRNNWithClusterPostagModel : public PostagModel {
     char_embed(model, char_size, char_dim),
     pos_embed(model, AlphabetCollection::get()->pos_map.size(), pos_dim),
     cluster_embed(model, 2, cluster_dim),
-    embed_input(embed_dim),
     merge(model, word_hidden_dim, word_hidden_dim, pos_dim, word_hidden_dim),
     dense(model, word_hidden_dim, AlphabetCollection::get()->pos_map.size()),
     p_unk_cluster(model.add_parameters({cluster_hidden_dim})),
@@ -95,19 +93,29 @@ struct CharacterRNNWithClusterPostagModel : public PostagModel {
     char_embed.new_graph(cg);
     cluster_embed.new_graph(cg);
     pos_embed.new_graph(cg);
-    embed_input.new_graph(cg);
     merge.new_graph(cg);
     dense.new_graph(cg);
     
     unk_cluster = dynet::parameter(cg, p_unk_cluster);
   }
 
+  unsigned get_char_encoding_dim() override { return char_hidden_dim + char_hidden_dim; }
+
+  dynet::Expression get_char_encoding(const std::vector<unsigned> & cids) override {
+    unsigned n_chars = cids.size();
+    std::vector<dynet::Expression> char_exprs(n_chars);
+    for (unsigned j = 0; j < n_chars; ++j) {
+      char_exprs[j] = char_embed.embed(cids[j]);
+    }
+    char_rnn.add_inputs(char_exprs);
+    auto payload = char_rnn.get_final();
+    return dynet::concatenate({ payload.first, payload.second });
+  }
+
   void build_input_layer(const std::vector<std::string> & words,
                          std::vector<dynet::Expression> & word_exprs) {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
-
-    std::vector<std::vector<float>> embeddings;
-    WordEmbedding::get()->render(words, embeddings);
+    std::vector<dynet::Expression> embeddings;
+    get_embeddings(*char_embed.cg, words, embeddings);
 
     std::vector<std::string> clusters;
     WordCluster::get()->render(words, clusters);
@@ -115,25 +123,10 @@ struct CharacterRNNWithClusterPostagModel : public PostagModel {
     unsigned n_words = words.size();
     word_exprs.resize(n_words);
 
-    for (unsigned i = 0; i < n_words; ++i) {
-      std::string word = words[i];
-      unsigned len = 0;
-      std::vector<unsigned> cids;
-      for (unsigned j = 0; j < word.size(); j += len) {
-        len = utf8_len(word[j]);
-        std::string ch = word.substr(j, len);
-        unsigned cid = (char_map.contains(ch) ? char_map.get(ch) : char_map.get(Corpus::UNK));
-        cids.push_back(cid);
-      }
-
-      unsigned n_chars = cids.size();
-      std::vector<dynet::Expression> char_exprs(n_chars);
-      for (unsigned j = 0; j < n_chars; ++j) {
-        char_exprs[j] = char_embed.embed(cids[j]);
-      }
-      char_rnn.add_inputs(char_exprs);
-      auto payload = char_rnn.get_final();
+    std::vector<dynet::Expression> char_encodings;
+    get_char_encodings(*char_embed.cg, words, char_encodings);
 
+    for (unsigned i = 0; i < n_words; ++i) {
       const std::string & cluster_type = clusters[i];
       dynet::Expression cluster_expr;
       if (cluster_type == Corpus::UNK) {
@@ -146,7 +139,7 @@ struct CharacterRNNWithClusterPostagModel : public PostagModel {
         cluster_rnn.add_inputs(bits_exprs);
         cluster_expr = cluster_rnn.get_final();
       }
-      word_exprs[i] = dynet::concatenate({ payload.first, payload.second, cluster_expr, embed_input.get_output(embeddings[i]) });
+      word_exprs[i] = dynet::concatenate({ char_encodings[i], cluster_expr, embeddings[i] });
     }
   }
 
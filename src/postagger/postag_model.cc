@@ -1,5 +1,8 @@
 #include "postag_model.h"
 #include "twpipe/alphabet_collection.h"
+#include "twpipe/embedding.h"
+#include "twpipe/elmo.h"
+#include <algorithm>
 
 namespace twpipe {
 
@@ -17,6 +20,8 @@ po::options_description PostagModel::get_options() {
     ("pos-cluster-n-layer", po::value<unsigned>()->default_value(1), "the number of layers for cluster-rnn.")
     ("pos-cluster-hidden-dim", po::value<unsigned>()->default_value(8), "the hidden dimension of cluster-nn.")
     ("pos-pos-dim", po::value<unsigned>()->default_value(16), "the dimension of postag.")
+    ("pos-char-cache-size", po::value<unsigned>()->default_value(1 << 16), "the number of words whose char encodings are cached when testing, 0 to disable.")
+    ("pos-freeze-size", po::value<unsigned>()->default_value(5000), "the number of vocabulary words whose char encodings are precomputed when testing.")
     ;
   return model_opts;
 }
@@ -28,6 +33,39 @@ PostagModel::PostagModel(dynet::ParameterCollection & model,
   embedding_type_(embedding_type) {
 }
 
+void PostagModel::get_embeddings(dynet::ComputationGraph & cg,
+                                 const std::vector<std::string> & words,
+                                 std::vector<dynet::Expression> & embeddings) {
+  std::vector<const float *> rows;
+  if (embedding_type_ == kStaticEmbeddings) {
+    WordEmbedding::get()->render(words, rows);
+    WordEmbedding::input(cg, WordEmbedding::get()->dim(), rows, embeddings);
+  } else {
+    ELMo::get()->render(words, rows);
+    WordEmbedding::input(cg, ELMo::get()->dim(), rows, embeddings);
+  }
+}
+
+dynet::Expression PostagModel::get_char_encoding(const std::vector<unsigned> & cids) {
+  BOOST_ASSERT_MSG(false, "[postag|model] the model doesn't encode characters.");
+  return dynet::Expression();
+}
+
+void PostagModel::get_char_encodings(dynet::ComputationGraph & cg,
+                                     const std::vector<std::string> & words,
+                                     std::vector<dynet::Expression> & encodings) {
+  char_cache.render(cg, get_char_encoding_dim(), words,
+                    [this](const std::vector<unsigned> & cids) { return get_char_encoding(cids); },
+                    encodings);
+}
+
+void PostagModel::freeze(unsigned n_words) {
+  if (get_char_encoding_dim() == 0) { return; }
+  char_cache.freeze(n_words, get_char_encoding_dim(),
+                    [this](dynet::ComputationGraph & cg) { new_graph(cg); },
+                    [this](const std::vector<unsigned> & cids) { return get_char_encoding(cids); });
+}
+
 void PostagModel::postag(const std::vector<std::string>& words) {
   std::vector<std::string> tags;
   postag(words, tags);
@@ -46,6 +84,54 @@ void PostagModel::postag(const std::vector<std::string>& words,
   decode(words, tags);
 }
 
+void PostagModel::decode_batch(const std::vector<std::vector<std::string>> & batch,
+                               std::vector<std::vector<std::string>> & batch_tags) {
+  Alphabet & pos_map = AlphabetCollection::get()->pos_map;
+  unsigned root_pos_id = pos_map.get(Corpus::ROOT);
+
+  unsigned n_sentences = batch.size();
+  unsigned max_n_words = 0;
+  std::vector<std::vector<dynet::Expression>> contexts(n_sentences);
+  for (unsigned s = 0; s < n_sentences; ++s) {
+    unsigned n_words = batch[s].size();
+    initialize(batch[s]);
+    get_contexts(n_words, contexts[s]);
+    max_n_words = std::max(max_n_words, n_words);
+  }
+
+  batch_tags.resize(n_sentences);
+  std::vector<unsigned> prev_labels(n_sentences, root_pos_id);
+  for (unsigned s = 0; s < n_sentences; ++s) { batch_tags[s].resize(batch[s].size()); }
+
+  std::vector<unsigned> active;
+  std::vector<dynet::Expression> logits;
+  for (unsigned i = 0; i < max_n_words; ++i) {
+    active.clear();
+    logits.clear();
+    for (unsigned s = 0; s < n_sentences; ++s) {
+      if (i >= batch[s].size()) { continue; }
+      dynet::Expression feature = get_feature(contexts[s][i], prev_labels[s]);
+      active.push_back(s);
+      logits.push_back(get_emit_score(feature));
+    }
+    // column j holds the scores of the j-th active sentence.
+    std::vector<float> scores = dynet::as_vector(dynet::concatenate_cols(logits).value());
+    for (unsigned j = 0; j < active.size(); ++j) {
+      auto begin = scores.begin() + j * pos_size;
+      unsigned label = std::max_element(begin, begin + pos_size) - begin;
+      batch_tags[active[j]][i] = pos_map.get(label);
+      prev_labels[active[j]] = label;
+    }
+  }
+}
+
+void PostagModel::postag_batch(const std::vector<std::vector<std::string>> & batch,
+                               std::vector<std::vector<std::string>> & batch_tags) {
+  dynet::ComputationGraph cg;
+  new_graph(cg);
+  decode_batch(batch, batch_tags);
+}
+
 std::pair<float, float> PostagModel::evaluate(const std::vector<std::string>& gold,
                                               const std::vector<std::string>& prediction) {
   BOOST_ASSERT_MSG(gold.size() == prediction.size(), "");
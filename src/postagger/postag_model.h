@@ -3,6 +3,7 @@
 
 #include <boost/program_options.hpp>
 #include "twpipe/corpus.h"
+#include "twpipe/word_encoding_cache.h"
 #include "dynet/expr.h"
 
 namespace po = boost::program_options;
@@ -15,6 +16,7 @@ struct PostagModel {
   dynet::ParameterCollection & model;
   unsigned pos_size;
   EmbeddingType embedding_type_;
+  WordEncodingCache char_cache;
 
   PostagModel(dynet::ParameterCollection & model,
               EmbeddingType embedding_type = kStaticEmbeddings);
@@ -26,8 +28,43 @@ struct PostagModel {
 
   virtual void initialize(const std::vector<std::string> & words) = 0;
 
+  /// The pretrained (static or contextual) embeddings of the words as inputs
+  /// of the graph.
+  void get_embeddings(dynet::ComputationGraph & cg,
+                      const std::vector<std::string> & words,
+                      std::vector<dynet::Expression> & embeddings);
+
+  /// The dimension of the char encoding of a word, 0 if the model doesn't
+  /// encode characters.
+  virtual unsigned get_char_encoding_dim() { return 0; }
+
+  /// The char encoding of a word from its char ids.
+  virtual dynet::Expression get_char_encoding(const std::vector<unsigned> & cids);
+
+  /// The char encodings of the words, through the frozen table and the
+  /// char cache.
+  void get_char_encodings(dynet::ComputationGraph & cg,
+                          const std::vector<std::string> & words,
+                          std::vector<dynet::Expression> & encodings);
+
+  /// Freeze the char encodings of the first n_words words of the word
+  /// alphabet. Only valid once the parameters are fixed.
+  void freeze(unsigned n_words);
+
+  /// Precompute what only depends on the parameters to speed up decoding.
+  /// Only valid once the parameters are fixed.
+  virtual void precompute() {}
+
   virtual dynet::Expression get_feature(unsigned i, unsigned prev_tag) = 0;
 
+  /// The per-word context of the sentence in the last initialize(), so that
+  /// several sentences can be decoded in the same graph.
+  virtual void get_contexts(unsigned n_words,
+                            std::vector<dynet::Expression> & contexts) = 0;
+
+  virtual dynet::Expression get_feature(const dynet::Expression & context,
+                                        unsigned prev_tag) = 0;
+
   virtual dynet::Expression get_emit_score(dynet::Expression & feature) = 0;
   
   virtual dynet::Expression objective(const Instance & inst) = 0;
@@ -39,6 +76,14 @@ struct PostagModel {
   void postag(const std::vector<std::string> & words,
               std::vector<std::string> & tags);
 
+  /// Greedily decode a batch of sentences in the current graph. Words at the
+  /// same position of all the sentences are scored with a single forward.
+  virtual void decode_batch(const std::vector<std::vector<std::string>> & batch,
+                            std::vector<std::vector<std::string>> & batch_tags);
+
+  void postag_batch(const std::vector<std::vector<std::string>> & batch,
+                    std::vector<std::vector<std::string>> & batch_tags);
+
   std::pair<float, float> evaluate(const std::vector<std::string> & gold,
                                    const std::vector<std::string> & prediction);
 };
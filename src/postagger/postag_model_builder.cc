@@ -52,6 +52,10 @@ PostagModelBuilder::PostagModelBuilder(po::variables_map & conf) {
   cluster_hidden_dim = (conf.count("pos-cluster-hidden-dim") ? conf["pos-cluster-hidden-dim"].as<unsigned>() : 0);
   cluster_n_layers = (conf.count("pos-cluster-n-layer") ? conf["pos-cluster-n-layer"].as<unsigned>() : 0);
   pos_dim = (conf.count("pos-pos-dim") ? conf["pos-pos-dim"].as<unsigned>() : 0);
+  char_cache_size = (conf.count("pos-char-cache-size") ?
+                     conf["pos-char-cache-size"].as<unsigned>() :
+                     WordEncodingCache::kDefaultCapacity);
+  freeze_size = (conf.count("pos-freeze-size") ? conf["pos-freeze-size"].as<unsigned>() : 0);
 }
 
 PostagModel * PostagModelBuilder::build(dynet::ParameterCollection & model) {
@@ -118,6 +122,7 @@ PostagModel * PostagModelBuilder::build(dynet::ParameterCollection & model) {
     _ERROR << "[postag|model_builder] unknow postag model: " << model_name;
     exit(1);
   }
+  engine->char_cache.capacity = char_cache_size;
   return engine;
 }
 
@@ -275,6 +280,10 @@ PostagModel * PostagModelBuilder::from_json(dynet::ParameterCollection & model)
 
   engine = build(model);
   globals->from_json(Model::kPostaggerName, model);
+  // the parameters are fixed from now on.
+  engine->char_cache.set_enabled(true);
+  engine->freeze(freeze_size);
+  engine->precompute();
   
   return engine;
 }
@@ -41,6 +41,8 @@ struct PostagModelBuilder {
   unsigned pos_size;
   unsigned pos_dim;
   unsigned embed_dim;
+  unsigned char_cache_size;
+  unsigned freeze_size;
 
   PostagModelBuilder(po::variables_map & conf);
 
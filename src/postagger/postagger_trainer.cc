@@ -1,6 +1,7 @@
 #include "postagger_trainer.h"
 #include "twpipe/model.h"
 #include "twpipe/logging.h"
+#include "twpipe/parallel.h"
 #include "twpipe/alphabet_collection.h"
 #include "twpipe/embedding.h"
 #include "twpipe/elmo.h"
@@ -34,27 +35,32 @@ void PostaggerTrainer::train(const Corpus & corpus) {
   unsigned n_processed = 0;
 
   for (unsigned iter = 1; iter <= max_iter; ++iter) {
-    std::shuffle(order.begin(), order.end(), *dynet::rndeng);
+    shuffle(corpus, order);
     _INFO << "[postag|train] start training at " << iter << "-th iteration.";
 
     float loss = 0.f;
-    for (unsigned sid : order) {
-      const Instance & inst = corpus.training_data.at(sid);
-
+    for (unsigned begin = 0, end = 0; begin < order.size(); begin = end) {
+      end = next_batch_end(begin, order.size());
       {
         dynet::ComputationGraph cg;
         engine.new_graph(cg);
-        dynet::Expression loss_expr = engine.objective(inst);
-        if (lambda_ > 0) {
-          loss_expr = loss_expr + (0.5f * lambda_ * inst.input_units.size()) * engine.l2();
+        std::vector<dynet::Expression> batch_loss;
+        float l2_coef = 0.f;
+        for (unsigned i = begin; i < end; ++i) {
+          const Instance & inst = corpus.training_data.at(order[i]);
+          batch_loss.push_back(engine.objective(inst));
+          l2_coef += 0.5f * lambda_ * inst.input_units.size();
         }
+        if (l2_coef > 0.f) { batch_loss.push_back(l2_coef * engine.l2()); }
+        dynet::Expression loss_expr = dynet::sum(batch_loss);
         float l = dynet::as_scalar(cg.forward(loss_expr));
         cg.backward(loss_expr);
         loss += l;
         trainer->update();
-        n_processed++;
       }
-      if (need_evaluate(iter, n_processed)) {
+      unsigned n_before = n_processed;
+      n_processed += (end - begin);
+      if (need_evaluate(iter, n_before, n_processed)) {
         float acc = evaluate(corpus);
         float prop = static_cast<float>(n_processed) / order.size();
         if (acc > best_acc) {
@@ -87,8 +93,11 @@ void PostaggerTrainer::train(const Corpus & corpus) {
 }
 
 float PostaggerTrainer::evaluate(const Corpus & corpus) {
-  float n_recall = 0, n_total = 0;
-  for (unsigned sid = 0; sid < corpus.n_devel; ++sid) {
+  // the parameters stay the same during evaluation.
+  engine.char_cache.set_enabled(true);
+  // counts[0] is the number of correct tags, counts[1] is the number of words.
+  std::vector<float> counts;
+  ParallelUtils::sum_counts(corpus.n_devel, evaluate_workers, 2, [&](unsigned sid, float * sums) {
     const Instance & inst = corpus.devel_data.at(sid);
 
     dynet::ComputationGraph cg;
@@ -105,11 +114,12 @@ float PostaggerTrainer::evaluate(const Corpus & corpus) {
     engine.decode(words, pred_postags);
     auto payload = engine.evaluate(gold_postags, pred_postags);
 
-    n_recall += payload.first;
-    n_total += payload.second;
-  }
+    sums[0] += payload.first;
+    sums[1] += payload.second;
+  }, counts);
 
-  return n_recall / n_total;
+  engine.char_cache.set_enabled(false);
+  return counts[0] / counts[1];
 }
 
 PostaggerEnsembleTrainer::PostaggerEnsembleTrainer(PostagModel & engine, 
@@ -136,7 +146,7 @@ void PostaggerEnsembleTrainer::train(Corpus & corpus,
   std::vector<unsigned> order;
   for (unsigned i = 0; i < ensemble_instances.size(); ++i) {
     unsigned id = ensemble_instances[i].id;
-    if (corpus.training_data.count(id) == 0) { continue; }
+    if (id >= corpus.training_data.size()) { continue; }
     order.push_back(i);
   }
 
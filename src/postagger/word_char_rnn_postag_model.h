@@ -20,7 +20,6 @@ struct WordCharacterRNNPostagModel : public PostagModel {
   SymbolEmbedding char_embed;
   SymbolEmbedding word_embed;
   SymbolEmbedding pos_embed;
-  InputLayer embed_input;
   DenseLayer dense1;
   DenseLayer dense2;
 
@@ -53,7 +52,6 @@ struct WordCharacterRNNPostagModel : public PostagModel {
     char_embed(model, char_size, char_dim),
     word_embed(model, word_size, word_dim),
     pos_embed(model, AlphabetCollection::get()->pos_map.size(), pos_dim),
-    embed_input(embed_dim),
     dense1(model, word_hidden_dim + word_hidden_dim + pos_dim, word_hidden_dim),
     dense2(model, word_hidden_dim, AlphabetCollection::get()->pos_map.size()),
     char_size(char_size),
@@ -86,52 +84,40 @@ struct WordCharacterRNNPostagModel : public PostagModel {
     word_rnn.new_graph(cg);
     word_embed.new_graph(cg);
     pos_embed.new_graph(cg);
-    embed_input.new_graph(cg);
     dense1.new_graph(cg);
     dense2.new_graph(cg);
   }
   
-  void initialize(const std::vector<std::string> & words) override {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
+  unsigned get_char_encoding_dim() override { return char_hidden_dim + char_hidden_dim; }
 
-    std::vector<std::vector<float>> embeddings;
-    if (embedding_type_ == kStaticEmbeddings) {
-      WordEmbedding::get()->render(words, embeddings);
-    } else {
-      ELMo::get()->render(words, embeddings);
+  dynet::Expression get_char_encoding(const std::vector<unsigned> & cids) override {
+    unsigned n_chars = cids.size();
+    std::vector<dynet::Expression> char_exprs(n_chars);
+    for (unsigned j = 0; j < n_chars; ++j) {
+      char_exprs[j] = char_embed.embed(cids[j]);
     }
+    char_rnn.add_inputs(char_exprs);
+    auto payload = char_rnn.get_final();
+    return dynet::concatenate({ payload.first, payload.second });
+  }
+
+  void initialize(const std::vector<std::string> & words) override {
+    std::vector<dynet::Expression> embeddings;
+    get_embeddings(*word_embed.cg, words, embeddings);
 
     unsigned n_words = words.size();
     std::vector<dynet::Expression> word_reprs(n_words);
 
+    std::vector<dynet::Expression> char_encodings;
+    get_char_encodings(*char_embed.cg, words, char_encodings);
+
     unsigned unk = AlphabetCollection::get()->word_map.get(Corpus::UNK);
     for (unsigned i = 0; i < n_words; ++i) {
-      std::string word = words[i];
-      unsigned wid = unk;
-      if (AlphabetCollection::get()->word_map.contains(word)) {
-        wid = AlphabetCollection::get()->word_map.get(word);
-      }
-      unsigned len = 0;
-      std::vector<unsigned> cids;
-      for (unsigned j = 0; j < word.size(); j += len) {
-        len = utf8_len(word[j]);
-        std::string ch = word.substr(j, len);
-        unsigned cid = (char_map.contains(ch) ? char_map.get(ch) : char_map.get(Corpus::UNK));
-        cids.push_back(cid);
-      }
-
-      unsigned n_chars = cids.size();
-      std::vector<dynet::Expression> char_exprs(n_chars);
-      for (unsigned j = 0; j < n_chars; ++j) {
-        char_exprs[j] = char_embed.embed(cids[j]);
-      }
-      char_rnn.add_inputs(char_exprs);
-      auto payload = char_rnn.get_final();
+      unsigned wid = AlphabetCollection::get()->word_map.find_or(words[i], unk);
       word_reprs[i] = dynet::concatenate({
-        payload.first,
-        payload.second,
+        char_encodings[i],
         word_embed.embed(wid),
-        embed_input.get_output(embeddings[i])
+        embeddings[i]
       });
     }
 
@@ -149,6 +135,20 @@ struct WordCharacterRNNPostagModel : public PostagModel {
     return feature;
   }
 
+  void get_contexts(unsigned n_words,
+                    std::vector<dynet::Expression> & contexts) override {
+    contexts.resize(n_words);
+    for (unsigned i = 0; i < n_words; ++i) {
+      auto payload = word_rnn.get_output(i);
+      contexts[i] = dynet::concatenate({ payload.first, payload.second });
+    }
+  }
+
+  dynet::Expression get_feature(const dynet::Expression & context,
+                                unsigned prev_tag) override {
+    return dynet::concatenate({ context, pos_embed.embed(prev_tag) });
+  }
+
   void decode(const std::vector<std::string> & words,
               std::vector<std::string> & tags) override {
     Alphabet & pos_map = AlphabetCollection::get()->pos_map;
@@ -18,7 +18,6 @@ struct WordRNNPostagModel : public PostagModel {
   BiRNNLayer<RNNBuilderType> word_rnn;
   SymbolEmbedding word_embed;
   SymbolEmbedding pos_embed;
-  InputLayer embed_input;
   DenseLayer dense1;
   DenseLayer dense2;
 
@@ -41,7 +40,6 @@ struct WordRNNPostagModel : public PostagModel {
     word_rnn(model, word_n_layers, word_dim + embed_dim, word_hidden_dim),
     word_embed(model, word_size, word_dim),
     pos_embed(model, AlphabetCollection::get()->pos_map.size(), pos_dim),
-    embed_input(embed_dim),
     dense1(model, word_hidden_dim * 2 + pos_dim, word_hidden_dim),
     dense2(model, word_hidden_dim, AlphabetCollection::get()->pos_map.size()),
     word_size(word_size),
@@ -64,30 +62,22 @@ struct WordRNNPostagModel : public PostagModel {
     word_rnn.new_graph(cg);
     word_embed.new_graph(cg);
     pos_embed.new_graph(cg);
-    embed_input.new_graph(cg);
     dense1.new_graph(cg);
     dense2.new_graph(cg);
   }
 
   void initialize(const std::vector<std::string> & words) override {
-    std::vector<std::vector<float>> embeddings;
-    if (embedding_type_ == kStaticEmbeddings) {
-      WordEmbedding::get()->render(words, embeddings);
-    } else {
-      ELMo::get()->render(words, embeddings);
-    }
+    std::vector<dynet::Expression> embeddings;
+    get_embeddings(*word_embed.cg, words, embeddings);
 
     unsigned n_words = words.size();
     unsigned unk = AlphabetCollection::get()->word_map.get(Corpus::UNK);
     std::vector<dynet::Expression> word_reprs(n_words);
     for (unsigned i = 0; i < n_words; ++i) {
       std::string word = words[i];
-      unsigned wid = unk;
-      if (AlphabetCollection::get()->word_map.contains(word)) {
-        wid = AlphabetCollection::get()->word_map.get(word);
-      }
+      unsigned wid = AlphabetCollection::get()->word_map.find_or(word, unk);
       word_reprs[i] = dynet::concatenate({
-        word_embed.embed(wid), embed_input.get_output(embeddings[i]) 
+        word_embed.embed(wid), embeddings[i] 
       });
     }
 
@@ -104,6 +94,20 @@ struct WordRNNPostagModel : public PostagModel {
     dynet::Expression feature = dynet::concatenate({ payload.first, payload.second, pos_embed.embed(prev_tag) });
     return feature;
   }
+
+  void get_contexts(unsigned n_words,
+                    std::vector<dynet::Expression> & contexts) override {
+    contexts.resize(n_words);
+    for (unsigned i = 0; i < n_words; ++i) {
+      auto payload = word_rnn.get_output(i);
+      contexts[i] = dynet::concatenate({ payload.first, payload.second });
+    }
+  }
+
+  dynet::Expression get_feature(const dynet::Expression & context,
+                                unsigned prev_tag) override {
+    return dynet::concatenate({ context, pos_embed.embed(prev_tag) });
+  }
   
   void decode(const std::vector<std::string> & words,
               std::vector<std::string> & tags) override {
@@ -1,5 +1,6 @@
 #include "lin_rnn_tokenize_model.h"
 #include "twpipe/unicode.h"
+#include "twpipe/char_encoder.h"
 
 twpipe::LinearTokenizeModel::LinearTokenizeModel(dynet::ParameterCollection &model) :
   TokenizeModel(model),
@@ -12,14 +13,13 @@ void twpipe::LinearTokenizeModel::get_gold_labels(const twpipe::Instance &inst,
                                                   std::vector<unsigned> &labels) {
   auto & input_units = inst.input_units;
 
-  unsigned len = 0;
+  std::vector<unsigned> cids;
+  CharEncoder::get()->encode(clean_input, cids);
   unsigned j = 1, k = 0; // j start from 1 because the first one is dummy root.
-  for (unsigned i = 0; i < clean_input.size(); i += len) {
-    len = utf8_len(clean_input[i]);
-    std::string ch = clean_input.substr(i, len);
-    unsigned lid = (ch == " " ? kO : (k == 0 ? kB : kI));
+  for (unsigned cid : cids) {
+    unsigned lid = (cid == space_cid ? kO : (k == 0 ? kB : kI));
     labels.push_back(lid);
-    if (ch != " ") {
+    if (cid != space_cid) {
       ++k;
       if (k == input_units[j].cids.size()) { k = 0; ++j; }
     }
@@ -59,6 +59,25 @@ void twpipe::LinearSentenceSegmentAndTokenizeModel::get_colored(const twpipe::In
   }
 }
 
+void twpipe::LinearTokenizeModel::get_tokens(const std::vector<std::string> &chars,
+                                             const std::vector<unsigned> &labels,
+                                             std::vector<std::string> &output) {
+  unsigned n_chars = chars.size();
+  std::string form = "";
+  for (unsigned i = 0; i < n_chars; ++i) {
+    if (labels[i] == kO) {
+      output.push_back(form);
+      form = "";
+    } else if (labels[i] == kB) {
+      if (form != "") { output.push_back(form); }
+      form = chars[i];
+    } else {
+      form += chars[i];
+    }
+  }
+  if (form != "") { output.push_back(form); }
+}
+
 void twpipe::LinearSentenceSegmentAndTokenizeModel::get_gold_labels(const twpipe::Instance &inst,
                                                                   const std::string &clean_input,
                                                                   std::vector<unsigned> &labels) {
@@ -66,47 +85,84 @@ void twpipe::LinearSentenceSegmentAndTokenizeModel::get_gold_labels(const twpipe
   std::vector<unsigned> colors;
   get_colored(inst, colors);
 
-  unsigned len = 0;
+  std::vector<unsigned> cids;
+  CharEncoder::get()->encode(clean_input, cids);
   unsigned j = 1, k = 0; // j start from 1 because the first one is dummy root.
-  for (unsigned i = 0; i < clean_input.size(); i += len) {
-    len = utf8_len(clean_input[i]);
-    std::string ch = clean_input.substr(i, len);
-    unsigned lid = (ch == " " ? kO : (k == 0 ? (j == 1 || colors[j - 1] != colors[j] ? kB1 : kB) : kI));
+  for (unsigned cid : cids) {
+    unsigned lid = (cid == space_cid ? kO : (k == 0 ? (j == 1 || colors[j - 1] != colors[j] ? kB1 : kB) : kI));
     labels.push_back(lid);
-    if (ch != " ") {
+    if (cid != space_cid) {
       ++k;
       if (k == input_units[j].cids.size()) { k = 0; ++j; }
     }
   }
 }
 
+void twpipe::LinearSentenceSegmentAndTokenizeModel::get_sentences(const std::vector<std::string> &chars,
+                                                                const std::vector<unsigned> &labels,
+                                                                std::vector<std::vector<std::string>> &output) {
+  unsigned n_chars = chars.size();
+  std::vector<std::string> sentence;
+  std::string form = "";
+  for (unsigned i = 0; i < n_chars; ++i) {
+    if (labels[i] == kO) {
+      sentence.push_back(form);
+      form = "";
+    } else if (labels[i] == kB1) {
+      if (form != "") { sentence.push_back(form); }
+      if (!sentence.empty()) {
+        output.push_back(sentence);
+      }
+      sentence.clear();
+      form = chars[i];
+    } else if (labels[i] == kB) {
+      if (form != "") { sentence.push_back(form); }
+      form = chars[i];
+    } else {
+      form += chars[i];
+    }
+  }
+  if (form != "") { sentence.push_back(form); }
+  if (sentence.size() > 0) { output.push_back(sentence); }
+}
+
 void twpipe::CharactersTokenizeModel::get_chars(const std::string &clean_input, std::vector<unsigned> &cids,
-                                                twpipe::Alphabet &char_map, std::vector<std::string> *chars) {
-  unsigned len = 0;
-  for (unsigned i = 0; i < clean_input.size(); i += len) {
-    len = utf8_len(clean_input[i]);
-    std::string ch = clean_input.substr(i, len);
-    if (chars != nullptr) { chars->push_back(ch); }
-    unsigned cid = (char_map.contains(ch) ? char_map.get(ch) : char_map.get(Corpus::UNK));
-    cids.push_back(cid);
+                                                std::vector<std::string> *chars) {
+  std::vector<unsigned> offsets;
+  CharEncoder::get()->encode(clean_input, cids, nullptr, (chars != nullptr ? &offsets : nullptr));
+  if (chars != nullptr) { split_chars(clean_input, offsets, *chars); }
+}
+
+void twpipe::CharactersTokenizeModel::split_chars(const std::string &clean_input,
+                                                  const std::vector<unsigned> &offsets,
+                                                  std::vector<std::string> &chars) {
+  unsigned n_chars = offsets.size();
+  for (unsigned i = 0; i < n_chars; ++i) {
+    unsigned end = (i + 1 < n_chars ? offsets[i + 1] : clean_input.size());
+    chars.push_back(clean_input.substr(offsets[i], end - offsets[i]));
+  }
+}
+
+void twpipe::CharactersTokenizeModel::get_best_labels(const std::vector<float> & scores,
+                                                      unsigned n_labels,
+                                                      std::vector<unsigned> & labels) {
+  unsigned n = scores.size() / n_labels;
+  labels.resize(n);
+  for (unsigned i = 0; i < n; ++i) {
+    auto begin = scores.begin() + i * n_labels;
+    labels[i] = std::max_element(begin, begin + n_labels) - begin;
   }
 }
 
 void twpipe::CharactersTokenizeModel::get_chars_and_char_categories(const std::string &clean_input,
                                                                     std::vector<unsigned> &cids,
                                                                     std::vector<unsigned> &ctids,
-                                                                    twpipe::Alphabet &char_map,
                                                                     std::vector<std::string> *chars) {
-  unsigned len = 0;
-  for (unsigned i = 0; i < clean_input.size(); i += len) {
-    len = utf8_len(clean_input[i]);
-    std::string ch = clean_input.substr(i, len);
-    char32_t unicode_chr = utf8_to_unicode_first_(ch);
-    uint8_t category = ufal::unilib::unicode::compact_category(unicode_chr);
-
-    if (chars != nullptr) { chars->push_back(ch); }
-    unsigned cid = (char_map.contains(ch) ? char_map.get(ch) : char_map.get(Corpus::UNK));
-    cids.push_back(cid);
-    ctids.push_back(category);
+  std::vector<char32_t> code_points;
+  std::vector<unsigned> offsets;
+  CharEncoder::get()->encode(clean_input, cids, &code_points, (chars != nullptr ? &offsets : nullptr));
+  for (char32_t code_point : code_points) {
+    ctids.push_back(ufal::unilib::unicode::compact_category(code_point));
   }
+  if (chars != nullptr) { split_chars(clean_input, offsets, *chars); }
 }
@@ -13,12 +13,21 @@ namespace twpipe {
 
 struct CharactersTokenizeModel {
   void get_chars(const std::string & clean_input, std::vector<unsigned> & cids,
-                 Alphabet & char_map, std::vector<std::string> * chars);
+                 std::vector<std::string> * chars);
 
   void get_chars_and_char_categories(const std::string & clean_input,
                                      std::vector<unsigned> & cids,
                                      std::vector<unsigned> & ctids,
-                                     Alphabet & char_map, std::vector<std::string> * chars);
+                                     std::vector<std::string> * chars);
+
+  /// Split the input into characters by their byte offsets.
+  void split_chars(const std::string & clean_input,
+                   const std::vector<unsigned> & offsets,
+                   std::vector<std::string> & chars);
+
+  /// Argmax over each column of a column-major n_labels x n matrix.
+  void get_best_labels(const std::vector<float> & scores, unsigned n_labels,
+                       std::vector<unsigned> & labels);
 };
 
 struct LinearTokenizeModel : public TokenizeModel, CharactersTokenizeModel {
@@ -33,6 +42,10 @@ struct LinearTokenizeModel : public TokenizeModel, CharactersTokenizeModel {
   void get_gold_labels(const twpipe::Instance &inst,
                        const std::string &clean_input,
                        std::vector<unsigned> &labels);
+
+  void get_tokens(const std::vector<std::string> & chars,
+                  const std::vector<unsigned> & labels,
+                  std::vector<std::string> & output);
 };
 
 template <class RNNBuilderType>
@@ -82,59 +95,78 @@ struct LinearRNNTokenizeModel : public LinearTokenizeModel {
     dense.new_graph(cg);
   }
 
-  void decode(const std::vector<unsigned> & cids, std::vector<unsigned> & ctids, std::vector<unsigned> & output) {
+  /// The logits of all the characters as a (kO + 1) x n_chars matrix.
+  dynet::Expression get_logits(const std::vector<unsigned> & cids, const std::vector<unsigned> & ctids) {
     unsigned n_chars = cids.size();
     std::vector<dynet::Expression> ch_exprs(n_chars);
     for (unsigned i = 0; i < n_chars; ++i) {
       ch_exprs[i] = dynet::concatenate({char_embed.embed(cids[i]), char_category_embed.embed(ctids[i])});
     }
     bi_rnn.add_inputs(ch_exprs);
-    output.resize(n_chars);
+    std::vector<dynet::Expression> logits(n_chars);
     for (unsigned i = 0; i < n_chars; ++i) {
       auto payload = bi_rnn.get_output(i);
-      dynet::Expression logits = dense.get_output(dynet::rectify(merge.get_output(payload.first, payload.second)));
-      std::vector<float> scores = dynet::as_vector((char_embed.cg)->get_value(logits));
-      output[i] = std::max_element(scores.begin(), scores.end()) - scores.begin();
+      logits[i] = dense.get_output(dynet::rectify(merge.get_output(payload.first, payload.second)));
     }
+    return dynet::concatenate_cols(logits);
   }
 
-  void decode(const std::string & input, std::vector<std::string> & output) override {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
+  void decode(const std::vector<unsigned> & cids, std::vector<unsigned> & ctids, std::vector<unsigned> & output) {
+    output.clear();
+    if (cids.empty()) { return; }
+    dynet::Expression logits = get_logits(cids, ctids);
+    get_best_labels(dynet::as_vector((char_embed.cg)->get_value(logits)), kO + 1, output);
+  }
 
+  void decode(const std::string & input, std::vector<std::string> & output) override {
     std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
     std::vector<unsigned> cids;
     std::vector<unsigned> ctids;
     std::vector<std::string> chars;
 
-    get_chars_and_char_categories(clean_input, cids, ctids, char_map, &chars);
-    unsigned n_chars = cids.size();
+    get_chars_and_char_categories(clean_input, cids, ctids, &chars);
     std::vector<unsigned> labels;
 
     decode(cids, ctids, labels);
+    get_tokens(chars, labels, output);
+  }
 
-    std::string form = "";
-    for (unsigned i = 0; i < n_chars; ++i) {
-      if (labels[i] == kO) {
-        output.push_back(form);
-        form = "";
-      } else if (labels[i] == kB) {
-        if (form != "") { output.push_back(form); }
-        form = chars[i];
-      } else {
-        form += chars[i];
-      }
+  void decode_batch(const std::vector<std::string> & inputs,
+                    std::vector<std::vector<std::string>> & results) override {
+    unsigned n_inputs = inputs.size();
+    std::vector<std::vector<std::string>> chars(n_inputs);
+    std::vector<dynet::Expression> logits(n_inputs);
+    int last = -1;
+    for (unsigned k = 0; k < n_inputs; ++k) {
+      std::string clean_input = std::regex_replace(inputs[k], one_more_space_regex, " ");
+      std::vector<unsigned> cids;
+      std::vector<unsigned> ctids;
+      get_chars_and_char_categories(clean_input, cids, ctids, &chars[k]);
+      if (cids.empty()) { continue; }
+      logits[k] = get_logits(cids, ctids);
+      last = k;
+    }
+
+    // forwarding the last logits computes those of all the inputs.
+    if (last >= 0) { (char_embed.cg)->get_value(logits[last]); }
+
+    results.resize(n_inputs);
+    std::vector<unsigned> labels;
+    for (unsigned k = 0; k < n_inputs; ++k) {
+      results[k].clear();
+      if (chars[k].empty()) { continue; }
+      get_best_labels(dynet::as_vector((char_embed.cg)->get_value(logits[k])), kO + 1, labels);
+      get_tokens(chars[k], labels, results[k]);
     }
-    if (form != "") { output.push_back(form); }
   }
 
   dynet::Expression objective(const Instance & inst) override {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
     std::string clean_input = std::regex_replace(inst.raw_sentence, one_more_space_regex, " ");
     std::vector<unsigned> cids;
     std::vector<unsigned> ctids;
     std::vector<unsigned> labels;
 
-    get_chars_and_char_categories(clean_input, cids, ctids, char_map, nullptr);
+    get_chars_and_char_categories(clean_input, cids, ctids, nullptr);
     get_gold_labels(inst, clean_input, labels);
 
     unsigned n_chars = cids.size();
@@ -180,6 +212,10 @@ struct LinearSentenceSegmentAndTokenizeModel : public SentenceSegmentAndTokenize
 
   void get_gold_labels(const Instance & inst, const std::string & clean_input,
                        std::vector<unsigned> & labels);
+
+  void get_sentences(const std::vector<std::string> & chars,
+                     const std::vector<unsigned> & labels,
+                     std::vector<std::vector<std::string>> & output);
 };
 
 template <class RNNBuilderType>
@@ -229,68 +265,78 @@ struct LinearRNNSentenceSegmentAndTokenizeModel : public LinearSentenceSegmentAn
     dense.new_graph(cg);
   }
 
-  void decode(const std::vector<unsigned> & cids, const std::vector<unsigned> & ctids, std::vector<unsigned> & output) {
+  /// The logits of all the characters as a (kO + 1) x n_chars matrix.
+  dynet::Expression get_logits(const std::vector<unsigned> & cids, const std::vector<unsigned> & ctids) {
     unsigned n_chars = cids.size();
     std::vector<dynet::Expression> ch_exprs(n_chars);
     for (unsigned i = 0; i < n_chars; ++i) {
       ch_exprs[i] = dynet::concatenate({char_embed.embed(cids[i]), char_category_embed.embed(ctids[i])});
     }
     bi_rnn.add_inputs(ch_exprs);
-    output.resize(n_chars);
+    std::vector<dynet::Expression> logits(n_chars);
     for (unsigned i = 0; i < n_chars; ++i) {
       auto payload = bi_rnn.get_output(i);
-      dynet::Expression logits = dense.get_output(dynet::rectify(merge.get_output(payload.first, payload.second)));
-      std::vector<float> scores = dynet::as_vector((char_embed.cg)->get_value(logits));
-      output[i] = std::max_element(scores.begin(), scores.end()) - scores.begin();
+      logits[i] = dense.get_output(dynet::rectify(merge.get_output(payload.first, payload.second)));
     }
+    return dynet::concatenate_cols(logits);
   }
 
-  void decode(const std::string & input, std::vector<std::vector<std::string>> & output) override {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
+  void decode(const std::vector<unsigned> & cids, const std::vector<unsigned> & ctids, std::vector<unsigned> & output) {
+    output.clear();
+    if (cids.empty()) { return; }
+    dynet::Expression logits = get_logits(cids, ctids);
+    get_best_labels(dynet::as_vector((char_embed.cg)->get_value(logits)), kO + 1, output);
+  }
 
+  void decode(const std::string & input, std::vector<std::vector<std::string>> & output) override {
     std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
     std::vector<unsigned> cids;
     std::vector<unsigned> ctids;
     std::vector<std::string> chars;
 
-    get_chars_and_char_categories(clean_input, cids, ctids, char_map, &chars);
-    unsigned n_chars = cids.size();
+    get_chars_and_char_categories(clean_input, cids, ctids, &chars);
     std::vector<unsigned> labels;
 
     decode(cids, ctids, labels);
+    get_sentences(chars, labels, output);
+  }
 
-    std::vector<std::string> sentence;
-    std::string form = "";
-    for (unsigned i = 0; i < n_chars; ++i) {
-      if (labels[i] == kO) {
-        sentence.push_back(form);
-        form = "";
-      } else if (labels[i] == kB1) {
-        if (form != "") { sentence.push_back(form); }
-        if (!sentence.empty()) {
-          output.push_back(sentence);
-        }
-        sentence.clear();
-        form = chars[i];
-      } else if (labels[i] == kB) {
-        if (form != "") { sentence.push_back(form); }
-        form = chars[i];
-      } else {
-        form += chars[i];
-      }
+  void decode_batch(const std::vector<std::string> & inputs,
+                    std::vector<std::vector<std::vector<std::string>>> & results) override {
+    unsigned n_inputs = inputs.size();
+    std::vector<std::vector<std::string>> chars(n_inputs);
+    std::vector<dynet::Expression> logits(n_inputs);
+    int last = -1;
+    for (unsigned k = 0; k < n_inputs; ++k) {
+      std::string clean_input = std::regex_replace(inputs[k], one_more_space_regex, " ");
+      std::vector<unsigned> cids;
+      std::vector<unsigned> ctids;
+      get_chars_and_char_categories(clean_input, cids, ctids, &chars[k]);
+      if (cids.empty()) { continue; }
+      logits[k] = get_logits(cids, ctids);
+      last = k;
+    }
+
+    // forwarding the last logits computes those of all the inputs.
+    if (last >= 0) { (char_embed.cg)->get_value(logits[last]); }
+
+    results.resize(n_inputs);
+    std::vector<unsigned> labels;
+    for (unsigned k = 0; k < n_inputs; ++k) {
+      results[k].clear();
+      if (chars[k].empty()) { continue; }
+      get_best_labels(dynet::as_vector((char_embed.cg)->get_value(logits[k])), kO + 1, labels);
+      get_sentences(chars[k], labels, results[k]);
     }
-    if (form != "") { sentence.push_back(form); }
-    if (sentence.size() > 0) { output.push_back(sentence); }
   }
 
   dynet::Expression objective(const Instance & inst) override {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
     std::string clean_input = std::regex_replace(inst.raw_sentence, one_more_space_regex, " ");
     std::vector<unsigned> cids;
     std::vector<unsigned> ctids;
     std::vector<unsigned> labels;
 
-    get_chars_and_char_categories(clean_input, cids, ctids, char_map, nullptr);
+    get_chars_and_char_categories(clean_input, cids, ctids, nullptr);
     get_gold_labels(inst, clean_input, labels);
 
     unsigned n_chars = cids.size();
@@ -4,6 +4,7 @@
 #include <regex>
 #include "tokenize_model.h"
 #include "twpipe/alphabet_collection.h"
+#include "twpipe/char_encoder.h"
 
 namespace twpipe {
 
@@ -66,20 +67,18 @@ struct SegmentalRNNTokenizeModel : public TokenizeModel {
   }
 
   void decode(const std::string & input, std::vector<std::string> & output) {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
     dynet::ComputationGraph * cg = merge.B.pg;
     std::string clean_input = std::regex_replace(input, one_more_space_regex, " ");
 
     std::vector<unsigned> cids;
+    std::vector<unsigned> offsets;
     std::vector<std::string> chars;
 
-    unsigned len = 0;
-    for (unsigned i = 0; i < clean_input.size(); i += len) {
-      len = utf8_len(clean_input[i]);
-      std::string ch = clean_input.substr(i, len);
-      chars.push_back(ch);
-      unsigned cid = (char_map.contains(ch) ? char_map.get(ch) : char_map.get(Corpus::UNK));
-      cids.push_back(cid);
+    CharEncoder::get()->encode(clean_input, cids, nullptr, &offsets);
+    unsigned n_offsets = offsets.size();
+    for (unsigned i = 0; i < n_offsets; ++i) {
+      unsigned end = (i + 1 < n_offsets ? offsets[i + 1] : clean_input.size());
+      chars.push_back(clean_input.substr(offsets[i], end - offsets[i]));
     }
 
     unsigned n_chars = cids.size();
@@ -98,34 +97,37 @@ struct SegmentalRNNTokenizeModel : public TokenizeModel {
     }
     seg_rnn.construct_chart(c);
 
-    std::vector<dynet::Expression> alpha(n_chars + 1);
-    std::vector<dynet::Expression> f;
-    std::vector<std::pair<unsigned, unsigned>> ijt;
-    std::vector<std::pair<unsigned, unsigned>> it; // for recording the gold
+    if (n_chars == 0) { return; }
 
-    it.push_back(std::make_pair(0, 0));
+    // score all the candidate segments with one forward. the score of
+    // segment [i, j) is at (j - 1) * max_seg_len + (j - i - 1) in the table.
+    std::vector<dynet::Expression> factors;
+    std::vector<unsigned> positions;
     for (unsigned j = 1; j <= n_chars; ++j) {
-      f.clear();
-      ijt.clear();
       unsigned i_start = (j < max_seg_len ? 0 : j - max_seg_len);
       for (unsigned i = i_start; i < j; ++i) {
-        dynet::Expression p = factor_score(i, j, false);
-        if (i == 0) {
-          f.push_back(p);
-        } else {
-          f.push_back(p + alpha[i]);
-        }
-        ijt.push_back(std::make_pair(i, j));
+        factors.push_back(factor_score(i, j, false));
+        positions.push_back((j - 1) * max_seg_len + (j - i - 1));
       }
-      BOOST_ASSERT_MSG(f.size() > 0, "There should be a result!");
-      unsigned max_id = 0;
-      float max_val = dynet::as_scalar(cg->get_value(f[0]));
-      for (unsigned id = 1; id < f.size(); ++id) {
-        auto val = dynet::as_scalar(cg->get_value(f[id]));
-        if (max_val < val) { max_val = val; max_id = id; }
+    }
+    std::vector<float> values = dynet::as_vector(cg->get_value(dynet::concatenate(factors)));
+    std::vector<float> table(n_chars * max_seg_len, -1e10f);
+    for (unsigned k = 0; k < positions.size(); ++k) { table[positions[k]] = values[k]; }
+
+    std::vector<float> alpha(n_chars + 1, 0.f);
+    std::vector<std::pair<unsigned, unsigned>> it; // for recording the best segment ending at j.
+    it.push_back(std::make_pair(0, 0));
+    for (unsigned j = 1; j <= n_chars; ++j) {
+      unsigned i_start = (j < max_seg_len ? 0 : j - max_seg_len);
+      const float * row = &table[(j - 1) * max_seg_len];
+      unsigned max_i = i_start;
+      float max_val = row[j - i_start - 1] + alpha[i_start];
+      for (unsigned i = i_start + 1; i < j; ++i) {
+        float val = row[j - i - 1] + alpha[i];
+        if (max_val < val) { max_val = val; max_i = i; }
       }
-      alpha[j] = f[max_id];
-      it.push_back(ijt[max_id]);
+      alpha[j] = max_val;
+      it.push_back(std::make_pair(max_i, j));
     }
 
     auto cur_j = n_chars;
@@ -146,19 +148,14 @@ struct SegmentalRNNTokenizeModel : public TokenizeModel {
   }
 
   dynet::Expression objective(const Instance & inst) {
-    Alphabet & char_map = AlphabetCollection::get()->char_map;
     const InputUnits & input_units = inst.input_units;
     std::string clean_input = std::regex_replace(inst.raw_sentence, one_more_space_regex, " ");
      
     std::vector<unsigned> segmentation; 
     std::vector<unsigned> cids;
-    unsigned len = 0;
+    CharEncoder::get()->encode(clean_input, cids);
     unsigned j = 1, k = 0;
-    for (unsigned i = 0; i < clean_input.size(); i += len) {
-      len = utf8_len(clean_input[i]);
-      std::string ch = clean_input.substr(i, len);
-      unsigned cid = char_map.get(ch);
-      cids.push_back(cid);
+    for (unsigned cid : cids) {
       if (cid != space_cid) {
         ++k;
         if (k == input_units[j].cids.size()) {
@@ -67,6 +67,22 @@ void twpipe::TokenizeModel::tokenize(const std::string &input, std::vector<std::
   decode(input, result);
 }
 
+void twpipe::TokenizeModel::decode_batch(const std::vector<std::string> & inputs,
+                                         std::vector<std::vector<std::string>> & results) {
+  results.resize(inputs.size());
+  for (unsigned i = 0; i < inputs.size(); ++i) {
+    results[i].clear();
+    decode(inputs[i], results[i]);
+  }
+}
+
+void twpipe::TokenizeModel::tokenize_batch(const std::vector<std::string> & inputs,
+                                           std::vector<std::vector<std::string>> & results) {
+  dynet::ComputationGraph cg;
+  new_graph(cg);
+  decode_batch(inputs, results);
+}
+
 
 std::tuple<float, float, float> twpipe::TokenizeModel::evaluate(const Instance & inst) {
   dynet::ComputationGraph cg;
@@ -113,6 +129,22 @@ void twpipe::SentenceSegmentAndTokenizeModel::sentsegment_and_tokenize(const std
   decode(input, result);
 }
 
+void twpipe::SentenceSegmentAndTokenizeModel::decode_batch(const std::vector<std::string> & inputs,
+                                                           std::vector<std::vector<std::vector<std::string>>> & results) {
+  results.resize(inputs.size());
+  for (unsigned i = 0; i < inputs.size(); ++i) {
+    results[i].clear();
+    decode(inputs[i], results[i]);
+  }
+}
+
+void twpipe::SentenceSegmentAndTokenizeModel::sentsegment_and_tokenize_batch(const std::vector<std::string> & inputs,
+                                                                             std::vector<std::vector<std::vector<std::string>>> & results) {
+  dynet::ComputationGraph cg;
+  new_graph(cg);
+  decode_batch(inputs, results);
+}
+
 std::tuple<float, float, float> twpipe::SentenceSegmentAndTokenizeModel::evaluate(const Instance & inst) {
   dynet::ComputationGraph cg;
   new_graph(cg);
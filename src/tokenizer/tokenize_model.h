@@ -36,10 +36,17 @@ struct TokenizeModel : public AbstractTokenizeModel {
 
   virtual void decode(const std::string & input, std::vector<std::string> & result) = 0;
 
+  /// Decode several inputs in the current graph.
+  virtual void decode_batch(const std::vector<std::string> & inputs,
+                            std::vector<std::vector<std::string>> & results);
+
   void tokenize(const std::string & input);
 
   void tokenize(const std::string & input, std::vector<std::string> & result);
 
+  void tokenize_batch(const std::vector<std::string> & inputs,
+                      std::vector<std::vector<std::string>> & results);
+
   std::tuple<float, float, float> evaluate(const Instance & inst) override;
 };
 
@@ -48,10 +55,17 @@ struct SentenceSegmentAndTokenizeModel : public AbstractTokenizeModel {
 
   virtual void decode(const std::string & input, std::vector<std::vector<std::string>> & result) = 0;
 
+  /// Decode several inputs in the current graph.
+  virtual void decode_batch(const std::vector<std::string> & inputs,
+                            std::vector<std::vector<std::vector<std::string>>> & results);
+
   void sentsegment_and_tokenize(const std::string &input);
 
   void sentsegment_and_tokenize(const std::string &input, std::vector<std::vector<std::string>> &result);
 
+  void sentsegment_and_tokenize_batch(const std::vector<std::string> & inputs,
+                                      std::vector<std::vector<std::vector<std::string>>> & results);
+
   std::tuple<float, float, float> evaluate(const Instance & inst) override;
 };
 
@@ -1,6 +1,7 @@
 #include <fstream>
 #include "tokenizer_trainer.h"
 #include "twpipe/logging.h"
+#include "twpipe/parallel.h"
 
 namespace twpipe {
 
@@ -18,15 +19,17 @@ TokenizerTrainer::TokenizerTrainer(AbstractTokenizeModel & engine,
 }
 
 float twpipe::TokenizerTrainer::evaluate(const Corpus & corpus) {
-  float n_recall = 0, n_pred = 0, n_gold = 0;
-  for (unsigned sid = 0; sid < corpus.n_devel; ++sid) {
+  // counts are the number of recalled, predicted and gold tokens.
+  std::vector<float> counts;
+  ParallelUtils::sum_counts(corpus.n_devel, evaluate_workers, 3, [&](unsigned sid, float * sums) {
     const Instance & inst = corpus.devel_data.at(sid);
 
     auto payload = engine.evaluate(inst);
-    n_recall += std::get<0>(payload);
-    n_pred += std::get<1>(payload);
-    n_gold += std::get<2>(payload);
-  }
+    sums[0] += std::get<0>(payload);
+    sums[1] += std::get<1>(payload);
+    sums[2] += std::get<2>(payload);
+  }, counts);
+  float n_recall = counts[0], n_pred = counts[1], n_gold = counts[2];
   float p = n_recall / n_gold;
   float r = n_recall / n_pred;
   float f = 2 * p * r / (p + r);
@@ -48,27 +51,33 @@ void twpipe::TokenizerTrainer::train(const Corpus & corpus) {
   unsigned n_processed = 0;
 
   for (unsigned iter = 1; iter <= max_iter; ++iter) {
-    std::shuffle(order.begin(), order.end(), *dynet::rndeng);
+    shuffle(corpus, order);
     _INFO << "[tokenize|train] start training at " << iter << "-th iteration.";
 
     float loss = 0;
-    for (unsigned sid = 0; sid < corpus.n_train; ++sid) {
-      const Instance & inst = corpus.training_data.at(order[sid]);
+    for (unsigned begin = 0, end = 0; begin < corpus.n_train; begin = end) {
+      end = next_batch_end(begin, corpus.n_train);
       {
         dynet::ComputationGraph cg;
         engine.new_graph(cg);
-        dynet::Expression loss_expr = engine.objective(inst);
-        if (lambda_ > 0) {
-          loss_expr = loss_expr + (0.5f * lambda_ * inst.input_units.size()) * engine.l2();
+        std::vector<dynet::Expression> batch_loss;
+        float l2_coef = 0.f;
+        for (unsigned sid = begin; sid < end; ++sid) {
+          const Instance & inst = corpus.training_data.at(order[sid]);
+          batch_loss.push_back(engine.objective(inst));
+          l2_coef += 0.5f * lambda_ * inst.input_units.size();
         }
+        if (l2_coef > 0.f) { batch_loss.push_back(l2_coef * engine.l2()); }
+        dynet::Expression loss_expr = dynet::sum(batch_loss);
         float l = dynet::as_scalar(cg.forward(loss_expr));
         cg.backward(loss_expr);
         loss += l;
 
         trainer->update();
-        n_processed++;
       }
-      if (need_evaluate(iter, n_processed)) {
+      unsigned n_before = n_processed;
+      n_processed += (end - begin);
+      if (need_evaluate(iter, n_before, n_processed)) {
         float f = evaluate(corpus);
         float prop = static_cast<float>(n_processed) / order.size();
         if (f > best_f) {
@@ -20,6 +20,8 @@
 #include "twpipe/elmo.h"
 #include "twpipe/embedding.h"
 #include "twpipe/cluster.h"
+#include "twpipe/parallel.h"
+#include "twpipe/server.h"
 
 namespace po = boost::program_options;
 
@@ -39,8 +41,11 @@ void init_command_line(int argc, char* argv[], po::variables_map& conf) {
     ("postag", "perform tagging")
     ("parse", "perform parsing")
     ("format", po::value<std::string>()->default_value("plain"), "the format of input data [plain|conll].")
+    ("threads", po::value<unsigned>()->default_value(1), "the number of parallel workers for the plain format.")
+    ("tokenize-batch-size", po::value<unsigned>()->default_value(1), "the number of plain lines tokenized in one graph.")
     ;
 
+  po::options_description server_opts = twpipe::Server::get_options();
   po::options_description model_opts = twpipe::Model::get_options();
   po::options_description embed_opts = twpipe::WordEmbedding::get_options();
   po::options_description elmo_opts = twpipe::ELMo::get_options();
@@ -61,6 +66,7 @@ void init_command_line(int argc, char* argv[], po::variables_map& conf) {
                               "       ./twpipe --train [training_opts] model_file [input_file]");
   cmd.add(generic_opts)
     .add(running_opts)
+    .add(server_opts)
     .add(model_opts)
     .add(elmo_opts)
     .add(embed_opts)
@@ -85,7 +91,9 @@ void init_command_line(int argc, char* argv[], po::variables_map& conf) {
   }
   twpipe::init_boost_log(conf.count("verbose") > 0);
   
-  if (!conf.count("input-file")) {
+  if (!conf.count("input-file") && !conf.count("convert-model") &&
+      !conf.count("convert-embedding") && !conf.count("convert-elmo") &&
+      !conf.count("serve")) {
     std::cerr << "Please specify input file." << std::endl;
     exit(1);
   }
@@ -97,6 +105,17 @@ int main(int argc, char* argv[]) {
   po::variables_map conf;
   init_command_line(argc, argv, conf);
 
+  if (conf.count("convert-model")) {
+    if (!conf.count("model")) {
+      _ERROR << "[twpipe] please specify the model to convert.";
+      exit(1);
+    }
+    twpipe::Model::get()->load(conf["model"].as<std::string>());
+    twpipe::Model::get()->save(conf["convert-model"].as<std::string>());
+    _INFO << "[twpipe] model converted to " << conf["convert-model"].as<std::string>();
+    return 0;
+  }
+
   if (conf.count("embedding")) {
     twpipe::WordEmbedding::get()->load(conf["embedding"].as<std::string>(),
                                        conf["embedding-dim"].as<unsigned>());
@@ -111,6 +130,26 @@ int main(int argc, char* argv[]) {
     twpipe::ELMo::get()->empty(conf["elmo-dim"].as<unsigned>());
   }
 
+  if (conf.count("convert-embedding") || conf.count("convert-elmo")) {
+    if (conf.count("convert-embedding")) {
+      if (!conf.count("embedding")) {
+        _ERROR << "[twpipe] please specify the embedding to convert.";
+        exit(1);
+      }
+      twpipe::WordEmbedding::get()->save(conf["convert-embedding"].as<std::string>());
+      _INFO << "[twpipe] embedding converted to " << conf["convert-embedding"].as<std::string>();
+    }
+    if (conf.count("convert-elmo")) {
+      if (!conf.count("elmo")) {
+        _ERROR << "[twpipe] please specify the elmo cache to convert.";
+        exit(1);
+      }
+      twpipe::ELMo::get()->save(conf["convert-elmo"].as<std::string>());
+      _INFO << "[twpipe] elmo cache converted to " << conf["convert-elmo"].as<std::string>();
+    }
+    return 0;
+  }
+
   if (conf.count("train")) {
     twpipe::Corpus corpus;
     corpus.load_training_data(conf["input-file"].as<std::string>());
@@ -187,7 +226,11 @@ int main(int argc, char* argv[]) {
     }
 
     std::string model_name = conf["model"].as<std::string>();
-    twpipe::Model::get()->save(model_name);
+    if (conf["model-format"].as<std::string>() == "json") {
+      twpipe::Model::get()->save_json(model_name);
+    } else {
+      twpipe::Model::get()->save(model_name);
+    }
   } else {
     std::string model_name = conf["model"].as<std::string>();
     twpipe::Model::get()->load(model_name);
@@ -243,51 +286,114 @@ int main(int argc, char* argv[]) {
         par_engine = par_builder.from_json(par_model);
       }
 
-      std::string buffer;
-      std::ifstream ifs(conf["input-file"].as<std::string>());
-      while (std::getline(ifs, buffer)) {
-        boost::algorithm::trim(buffer);
+      unsigned beam_size = conf["parse-beam-size"].as<unsigned>();
+      unsigned n_best = conf["parse-nbest"].as<unsigned>();
+      if (n_best > std::max(beam_size, 1u)) {
+        _WARN << "[twpipe] --parse-nbest is larger than the beam, only " << std::max(beam_size, 1u)
+          << " tree(s) will be output.";
+      }
+
+      auto process_batch = [&](const std::vector<std::string> & lines, std::ostream & os) {
+        std::vector<std::string> buffers(lines.size());
+        for (unsigned b = 0; b < lines.size(); ++b) {
+          buffers[b] = boost::algorithm::trim_copy(lines[b]);
+        }
         if (seg_tok_engine != nullptr) {
-          std::vector<std::vector<std::string>> sentences;
-          seg_tok_engine->sentsegment_and_tokenize(buffer, sentences);
+          std::vector<std::vector<std::vector<std::string>>> batch_sentences;
+          seg_tok_engine->sentsegment_and_tokenize_batch(buffers, batch_sentences);
 
-          std::vector<std::string> postags;
-          std::vector<unsigned> heads;
-          std::vector<std::string> deprels;
+          for (unsigned b = 0; b < buffers.size(); ++b) {
+            const std::string & buffer = buffers[b];
+            const std::vector<std::vector<std::string>> & sentences = batch_sentences[b];
 
-          for (unsigned s = 0; s < sentences.size(); ++s) {
-            const std::vector<std::string> & tokens = sentences[s];
+            std::vector<std::vector<std::string>> batch_postags;
+            std::vector<std::vector<unsigned>> nbest_heads;
+            std::vector<std::vector<std::string>> nbest_deprels;
+            std::vector<float> nbest_scores;
 
             if (pos_engine != nullptr) {
-              pos_engine->postag(tokens, postags);
-            }
-            if (par_engine != nullptr) {
-              par_engine->predict(tokens, postags, heads, deprels);
-            }
-            if (s == 0) {
-              std::cout << "# text = " << buffer << "\n";
+              pos_engine->postag_batch(sentences, batch_postags);
+            } else {
+              batch_postags.resize(sentences.size());
             }
-            std::cout << "# sent_id = " << s + 1 << "\n";
-            for (unsigned i = 0; i < tokens.size(); ++i) {
-              std::cout << i + 1 << "\t" << tokens[i] << "\t_\t"
-                        << (pos_engine != nullptr ? postags[i] : "_") << "\t_\t_\t"
-                        << (par_engine != nullptr ? std::to_string(heads[i]) : "_") << "\t"
-                        << (par_engine != nullptr ? deprels[i] : "_") << "\t_\t_\n";
+            for (unsigned s = 0; s < sentences.size(); ++s) {
+              const std::vector<std::string> & tokens = sentences[s];
+              const std::vector<std::string> & postags = batch_postags[s];
+
+              if (par_engine != nullptr) {
+                par_engine->predict(tokens, postags, beam_size, n_best,
+                                    nbest_heads, nbest_deprels, nbest_scores);
+              } else {
+                nbest_heads.resize(1);
+                nbest_deprels.resize(1);
+              }
+              if (s == 0) {
+                os << "# text = " << buffer << "\n";
+              }
+              for (unsigned k = 0; k < nbest_heads.size(); ++k) {
+                const std::vector<unsigned> & heads = nbest_heads[k];
+                const std::vector<std::string> & deprels = nbest_deprels[k];
+                os << "# sent_id = " << s + 1 << "\n";
+                if (beam_size > 1 && n_best > 1) {
+                  os << "# nbest = " << k + 1 << "\n";
+                  os << "# score = " << nbest_scores[k] << "\n";
+                }
+                for (unsigned i = 0; i < tokens.size(); ++i) {
+                  os << i + 1 << "\t" << tokens[i] << "\t_\t"
+                     << (pos_engine != nullptr ? postags[i] : "_") << "\t_\t_\t"
+                     << (par_engine != nullptr ? std::to_string(heads[i]) : "_") << "\t"
+                     << (par_engine != nullptr ? deprels[i] : "_") << "\t_\t_\n";
+                }
+                os << "\n";
+              }
             }
-            std::cout << "\n";
           }
         } else if (tok_engine != nullptr) {
-          std::vector<std::string> tokens;
-          tok_engine->tokenize(buffer, tokens);
+          std::vector<std::vector<std::string>> batch_tokens;
+          tok_engine->tokenize_batch(buffers, batch_tokens);
 
-          std::cout << "# text = " << buffer << "\n";
-          for (unsigned i = 0; i < tokens.size(); ++i) {
-            std::cout << i + 1 << "\t" << tokens[i] << "\t_\t_\t_\t_\t_\t_\t_\t_\n";
+          for (unsigned b = 0; b < buffers.size(); ++b) {
+            const std::vector<std::string> & tokens = batch_tokens[b];
+            os << "# text = " << buffers[b] << "\n";
+            for (unsigned i = 0; i < tokens.size(); ++i) {
+              os << i + 1 << "\t" << tokens[i] << "\t_\t_\t_\t_\t_\t_\t_\t_\n";
+            }
+            os << "\n";
           }
-          std::cout << "\n";
         }
+      };
+
+      auto process_line = [&](const std::string & line, std::ostream & os) {
+        process_batch({ line }, os);
+      };
+
+      unsigned n_threads = conf["threads"].as<unsigned>();
+      if (conf.count("serve")) {
+        twpipe::Server::serve(conf, process_line);
+      } else if (n_threads > 1) {
+        _INFO << "[twpipe] processing with " << n_threads << " workers.";
+        twpipe::ParallelUtils::process_lines(conf["input-file"].as<std::string>(),
+                                             n_threads, process_line, std::cout);
+      } else {
+        // lines are tokenized in batches of --tokenize-batch-size within one graph.
+        unsigned batch_size = std::max(conf["tokenize-batch-size"].as<unsigned>(), 1u);
+        std::vector<std::string> lines;
+        std::string buffer;
+        std::ifstream ifs(conf["input-file"].as<std::string>());
+        while (std::getline(ifs, buffer)) {
+          lines.push_back(buffer);
+          if (lines.size() == batch_size) {
+            process_batch(lines, std::cout);
+            lines.clear();
+          }
+        }
+        if (!lines.empty()) { process_batch(lines, std::cout); }
       }
     } else {
+      if (conf.count("serve")) {
+        _ERROR << "[twpipe] --serve only supports the plain format.";
+        exit(1);
+      }
       // for conll format, tokenization is impossible.
       twpipe::PostagModel * pos_engine = nullptr;
       twpipe::ParseModel * par_engine = nullptr;
@@ -316,6 +422,12 @@ int main(int argc, char* argv[]) {
         par_engine = par_builder.from_json(par_model);
       }
   
+      // only the best tree is output and evaluated for the conll format.
+      unsigned beam_size = conf["parse-beam-size"].as<unsigned>();
+      std::vector<std::vector<unsigned>> nbest_heads;
+      std::vector<std::vector<std::string>> nbest_deprels;
+      std::vector<float> nbest_scores;
+
       std::vector<std::string> tokens;
       std::vector<std::string> postags, gold_postags;
       std::vector<unsigned> heads, gold_heads;
@@ -340,7 +452,13 @@ int main(int argc, char* argv[]) {
             }
           }
           if (par_engine != nullptr) {
-            par_engine->predict(tokens, postags, heads, deprels);
+            if (beam_size > 1) {
+              par_engine->predict(tokens, postags, beam_size, 1, nbest_heads, nbest_deprels, nbest_scores);
+              heads = nbest_heads[0];
+              deprels = nbest_deprels[0];
+            } else {
+              par_engine->predict(tokens, postags, heads, deprels);
+            }
           }
 
           boost::algorithm::trim(header);
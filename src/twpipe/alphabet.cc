@@ -2,11 +2,18 @@
 #include "logging.h"
 #include <set>
 #include <tuple>
+#include <limits>
 
 namespace twpipe {
 
-Alphabet::Alphabet() : max_id(0), freezed(false), in_order(true) {
+const unsigned Alphabet::kNone = std::numeric_limits<unsigned>::max();
 
+Alphabet::Alphabet() : max_id(0), n_strings(0), freezed(false), in_order(true) {
+  Slot empty;
+  empty.key.offset = 0;
+  empty.key.size = 0;
+  empty.id = kNone;
+  slots.assign(16, empty);
 }
 
 void Alphabet::freeze() {
@@ -17,54 +24,112 @@ unsigned Alphabet::size() const {
   return max_id;
 }
 
-unsigned Alphabet::get(const std::string& str) const {
-  const auto found = str_to_id.find(str);
-  if (found == str_to_id.end()) {
-    _ERROR << "Alphabet :: str[\"" << str << "\"] not found!";
+size_t Alphabet::hash(const StringRef& str) {
+  // FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < str.size; ++i) {
+    h ^= static_cast<unsigned char>(str.data[i]);
+    h *= 1099511628211ULL;
+  }
+  return static_cast<size_t>(h);
+}
+
+size_t Alphabet::find_slot(const StringRef& str) const {
+  size_t mask = slots.size() - 1;
+  size_t i = hash(str) & mask;
+  while (slots[i].id != kNone && !(get_key(slots[i]) == str)) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+void Alphabet::rehash(size_t n_slots) {
+  Slot empty;
+  empty.key.offset = 0;
+  empty.key.size = 0;
+  empty.id = kNone;
+  std::vector<Slot> old_slots(n_slots, empty);
+  old_slots.swap(slots);
+  for (const Slot & slot : old_slots) {
+    if (slot.id != kNone) { slots[find_slot(get_key(slot))] = slot; }
+  }
+}
+
+unsigned Alphabet::get(const StringRef& str) const {
+  unsigned id = find_or(str, kNone);
+  if (id == kNone) {
+    _ERROR << "Alphabet :: str[\"" << str.str() << "\"] not found!";
     abort();
   }
-  return found->second;
+  return id;
 }
 
 std::string Alphabet::get(unsigned id) const {
-  const auto found = id_to_str.find(id);
-  if (found == id_to_str.end()) {
+  if (!contains(id)) {
     _ERROR << "Alphabet :: id[" << id << "] not found!";
     abort();
   }
-  return found->second;
+  return get_ref(id).str();
 }
 
-bool Alphabet::contains(const std::string& str) const {
-  const auto found = str_to_id.find(str);
-  return (found != str_to_id.end());
+StringRef Alphabet::get_ref(unsigned id) const {
+  const Span & span = spans[id];
+  return StringRef(arena.data() + span.offset, span.size);
+}
+
+unsigned Alphabet::find_or(const StringRef& str, unsigned default_id) const {
+  unsigned id = slots[find_slot(str)].id;
+  return (id == kNone ? default_id : id);
+}
+
+bool Alphabet::contains(const StringRef& str) const {
+  return slots[find_slot(str)].id != kNone;
 }
 
 bool Alphabet::contains(unsigned id) const {
-  const auto found = id_to_str.find(id);
-  return (found != id_to_str.end());
+  return id < spans.size() && spans[id].offset != kNone;
 }
 
-unsigned Alphabet::insert(const std::string& str) {
+unsigned Alphabet::insert(const StringRef& str) {
   BOOST_ASSERT_MSG(freezed == false, "Corpus::Insert should not insert into freezed alphabet.");
-  if (contains(str)) {
-    return get(str);
+  unsigned id = find_or(str, kNone);
+  if (id != kNone) {
+    return id;
   }
-
-  str_to_id[str] = max_id;
-  id_to_str[max_id] = str;
-  max_id++;
-  return max_id - 1;
+  return insert(str, max_id);
 }
 
-unsigned Alphabet::insert(const std::string& str, unsigned id) {
-  if (str_to_id.count(str) || id_to_str.count(id)) {
-    _WARN << "[alphabet] duplicated key insert (" << str << ", " << id << ")";
+unsigned Alphabet::insert(const StringRef& str, unsigned id) {
+  size_t slot = find_slot(str);
+  if (slots[slot].id != kNone || contains(id)) {
+    _WARN << "[alphabet] duplicated key insert (" << str.str() << ", " << id << ")";
   }
-  str_to_id[str] = id;
-  id_to_str[id] = str;
+
+  // the string is appended before being referred by the slot, as str may
+  // point into the arena.
+  Span span;
+  span.offset = static_cast<uint32_t>(arena.size());
+  span.size = static_cast<uint32_t>(str.size);
+  arena.append(str.data, str.size);
+  if (id >= spans.size()) {
+    Span none;
+    none.offset = kNone;
+    none.size = 0;
+    spans.resize(id + 1, none);
+  }
+  spans[id] = span;
   if (id + 1 > max_id) { max_id = id + 1; }
+
+  if (slots[slot].id == kNone) {
+    slots[slot].key = span;
+    slots[slot].id = id;
+    // keep the load factor under 1/2.
+    if (++n_strings * 2 > slots.size()) { rehash(slots.size() * 2); }
+  } else {
+    // the string is already a key, only its id changes.
+    slots[slot].id = id;
+  }
   return id;
 }
 
-}
\ No newline at end of file
+}
@@ -2,18 +2,56 @@
 #define __TWPIPE_ALPHABET_H__
 
 #include <string>
-#include <unordered_map>
+#include <vector>
+#include <cstring>
+#include <cstdint>
 #include <boost/functional/hash.hpp>
 
 namespace twpipe {
 
+/// A non-owning reference to a string (std::string_view is C++17).
+struct StringRef {
+  const char * data;
+  size_t size;
+
+  StringRef() : data(""), size(0) {}
+  StringRef(const char * data, size_t size) : data(data), size(size) {}
+  StringRef(const char * str) : data(str), size(std::strlen(str)) {}
+  StringRef(const std::string & str) : data(str.data()), size(str.size()) {}
+
+  std::string str() const { return std::string(data, size); }
+
+  bool operator == (const StringRef & other) const {
+    return size == other.size && std::memcmp(data, other.data, size) == 0;
+  }
+};
+
+/**
+ * The strings are stored back-to-back in a single arena, looked up through
+ * an open-addressing (linear probing) table of (string, id) slots, and
+ * id-to-string is a dense vector of arena spans.
+ *
+ * A slot keeps its own string, so when an id is inserted again with another
+ * string, both strings map to the id and the id maps to the last string.
+ */
 struct Alphabet {
-  typedef std::unordered_map<std::string, unsigned> StringToIdMap;
-  typedef std::unordered_map<unsigned, std::string> IdToStringMap;
+  struct Span {
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  struct Slot {
+    Span key;
+    unsigned id;  // kNone for the empty slot.
+  };
+
+  static const unsigned kNone;
 
   unsigned max_id;
-  StringToIdMap str_to_id;
-  IdToStringMap id_to_str;
+  std::string arena;
+  std::vector<Span> spans;      // indexed by id.
+  std::vector<Slot> slots;
+  unsigned n_strings;
   bool freezed;
   bool in_order;
 
@@ -21,12 +59,26 @@ struct Alphabet {
 
   void freeze();
   unsigned size() const;
-  unsigned get(const std::string& str) const;
+  unsigned get(const StringRef& str) const;
   std::string get(unsigned id) const;
-  bool contains(const std::string& str) const;
+  StringRef get_ref(unsigned id) const;
+  /// The id of the string, or default_id if it is not in the alphabet.
+  unsigned find_or(const StringRef& str, unsigned default_id) const;
+  bool contains(const StringRef& str) const;
   bool contains(unsigned id) const;
-  unsigned insert(const std::string& str);
-  unsigned insert(const std::string& str, unsigned id);
+  unsigned insert(const StringRef& str);
+  unsigned insert(const StringRef& str, unsigned id);
+
+  static size_t hash(const StringRef& str);
+
+protected:
+  StringRef get_key(const Slot & slot) const {
+    return StringRef(arena.data() + slot.key.offset, slot.key.size);
+  }
+
+  /// The slot of the string, either holding it or the empty one to put it in.
+  size_t find_slot(const StringRef& str) const;
+  void rehash(size_t n_slots);
 };
 
 }
@@ -52,4 +104,4 @@ struct hash<HashVector> {
 };
 }
 
-#endif  //  end for __TWPIPE_ALPHABET_H__
\ No newline at end of file
+#endif  //  end for __TWPIPE_ALPHABET_H__
@@ -0,0 +1,123 @@
+#include "char_encoder.h"
+#include "alphabet_collection.h"
+#include "corpus.h"
+
+namespace twpipe {
+
+namespace {
+
+struct Utf8LengthTable {
+  unsigned char length[256];
+
+  Utf8LengthTable() {
+    for (unsigned x = 0; x < 256; ++x) {
+      if (0 == (0x80 & x))         { length[x] = 1; }
+      else if (0xc0 == (0xe0 & x)) { length[x] = 2; }
+      else if (0xe0 == (0xf0 & x)) { length[x] = 3; }
+      else if (0xf0 == (0xf8 & x)) { length[x] = 4; }
+      else if (0xf8 == (0xfc & x)) { length[x] = 5; }
+      else if (0xfc == (0xfe & x)) { length[x] = 6; }
+      // continuation and invalid bytes are taken as a single character.
+      else                         { length[x] = 1; }
+    }
+  }
+};
+
+const Utf8LengthTable utf8_length_table;
+
+}
+
+CharEncoder * CharEncoder::instance = nullptr;
+
+const char32_t CharEncoder::kBMPSize = 0x10000;
+
+CharEncoder::CharEncoder() :
+  char_map(&AlphabetCollection::get()->char_map),
+  unk(0),
+  built_size(0) {
+}
+
+CharEncoder * CharEncoder::get() {
+  if (instance == nullptr) {
+    instance = new CharEncoder();
+  }
+  return instance;
+}
+
+unsigned CharEncoder::length(unsigned char lead) {
+  return utf8_length_table.length[lead];
+}
+
+bool CharEncoder::decode(const char * p, unsigned len, char32_t & code_point) {
+  static const unsigned char lead_mask[] = { 0, 0x7f, 0x1f, 0x0f, 0x07, 0x03, 0x01 };
+  static const char32_t min_code_point[] = { 0, 0, 0x80, 0x800, 0x10000, 0x200000, 0x4000000 };
+  unsigned char lead = static_cast<unsigned char>(p[0]);
+  if (len == 1) {
+    code_point = lead;
+    return (lead & 0x80) == 0;
+  }
+  code_point = lead & lead_mask[len];
+  for (unsigned i = 1; i < len; ++i) {
+    unsigned char ch = static_cast<unsigned char>(p[i]);
+    if ((ch & 0xc0) != 0x80) { return false; }
+    code_point = (code_point << 6) | (ch & 0x3f);
+  }
+  // overlong forms are different strings in the alphabet.
+  return code_point >= min_code_point[len];
+}
+
+void CharEncoder::build() {
+  unk = char_map->get(Corpus::UNK);
+  bmp.assign(kBMPSize, unk);
+  astral.clear();
+  for (unsigned id = 0; id < char_map->size(); ++id) {
+    if (!char_map->contains(id)) { continue; }
+    StringRef ch = char_map->get_ref(id);
+    if (ch.size == 0 || length(ch.data[0]) != ch.size) { continue; }
+    char32_t code_point;
+    if (!decode(ch.data, ch.size, code_point)) { continue; }
+    // skip the ids whose string is re-assigned to another id.
+    if (char_map->find_or(ch, Alphabet::kNone) != id) { continue; }
+    if (code_point < kBMPSize) {
+      bmp[code_point] = id;
+    } else {
+      astral[code_point] = id;
+    }
+  }
+  built_size = char_map->size();
+}
+
+unsigned CharEncoder::encode(char32_t code_point) {
+  if (built_size != char_map->size()) { build(); }
+  if (code_point < kBMPSize) { return bmp[code_point]; }
+  auto found = astral.find(code_point);
+  return (found == astral.end() ? unk : found->second);
+}
+
+void CharEncoder::encode(const StringRef & text,
+                         std::vector<unsigned> & cids,
+                         std::vector<char32_t> * code_points,
+                         std::vector<unsigned> * offsets) {
+  if (built_size != char_map->size()) { build(); }
+  size_t len = 0;
+  for (size_t i = 0; i < text.size; i += len) {
+    len = length(text.data[i]);
+    bool truncated = (i + len > text.size);
+    if (truncated) { len = text.size - i; }
+
+    char32_t code_point;
+    unsigned cid;
+    if (!truncated && decode(text.data + i, len, code_point)) {
+      cid = encode(code_point);
+    } else {
+      // malformed characters are looked up as raw bytes.
+      code_point = 0xfffd;
+      cid = char_map->find_or(StringRef(text.data + i, len), unk);
+    }
+    cids.push_back(cid);
+    if (code_points != nullptr) { code_points->push_back(code_point); }
+    if (offsets != nullptr) { offsets->push_back(static_cast<unsigned>(i)); }
+  }
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef __TWPIPE_CHAR_ENCODER_H__
+#define __TWPIPE_CHAR_ENCODER_H__
+
+#include <vector>
+#include <unordered_map>
+#include "alphabet.h"
+
+namespace twpipe {
+
+/**
+ * Encode UTF-8 text into the character ids of the char alphabet. The
+ * characters are decoded in place, code points in the BMP are mapped
+ * through a direct array and the others through a hash table, so no
+ * substring is built and the alphabet is not probed per character. The
+ * tables are rebuilt when the alphabet grows.
+ */
+struct CharEncoder {
+protected:
+  static CharEncoder * instance;
+  static const char32_t kBMPSize;
+
+  const Alphabet * char_map;
+  unsigned unk;
+  unsigned built_size;
+  std::vector<unsigned> bmp;
+  std::unordered_map<char32_t, unsigned> astral;
+
+  CharEncoder();
+
+  void build();
+
+  /// Decode the character at p, false if it is not a well-formed one.
+  static bool decode(const char * p, unsigned len, char32_t & code_point);
+
+public:
+  static CharEncoder * get();
+
+  /// The byte length of the UTF-8 character by its leading byte.
+  static unsigned length(unsigned char lead);
+
+  /// The id of the character, unknown characters are mapped to UNK.
+  unsigned encode(char32_t code_point);
+
+  /// Append the ids of the characters in the text. Optionally append the
+  /// code point and the byte offset of each character.
+  void encode(const StringRef & text,
+              std::vector<unsigned> & cids,
+              std::vector<char32_t> * code_points = nullptr,
+              std::vector<unsigned> * offsets = nullptr);
+};
+
+}
+
+#endif  //  end for __TWPIPE_CHAR_ENCODER_H__
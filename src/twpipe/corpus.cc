@@ -1,5 +1,6 @@
 #include "corpus.h"
 #include "alphabet_collection.h"
+#include "char_encoder.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -58,7 +59,6 @@ void Corpus::vector_to_input_units(const std::vector<std::string>& words,
   units.clear();
 
   Alphabet & word_map = AlphabetCollection::get()->word_map;
-  Alphabet & char_map = AlphabetCollection::get()->char_map;
   Alphabet & pos_map = AlphabetCollection::get()->pos_map;
 
   InputUnit unit;
@@ -71,26 +71,19 @@ void Corpus::vector_to_input_units(const std::vector<std::string>& words,
   unit.feature = Corpus::ROOT;
   units.push_back(unit);
 
+  const unsigned unk = word_map.get(Corpus::UNK);
   for (unsigned i = 0; i < words.size(); ++i) {
     const std::string & word = words[i];
     const std::string & postag = postags[i];
 
-    unit.wid = (word_map.contains(word) ? word_map.get(word) : word_map.get(Corpus::UNK));
+    unit.wid = word_map.find_or(word, unk);
     unit.pid = pos_map.get(postag);
     unit.aux_wid = unit.wid;
     unit.word = word;
     unit.postag = postag;
 
-    unsigned cur = 0;
     unit.cids.clear();
-    while (cur < word.size()) {
-      unsigned len = utf8_len(word[cur]);
-      std::string ch_str = word.substr(cur, len);
-      unit.cids.push_back(
-        char_map.contains(ch_str) ? char_map.get(ch_str) : char_map.get(Corpus::UNK)
-      );
-      cur += len;
-    }
+    CharEncoder::get()->encode(word, unit.cids);
     units.push_back(unit);
   }
 }
@@ -143,13 +136,15 @@ void Corpus::load_training_data(const std::string& filename) {
   }
 
   n_train = 0;
+  training_data.clear();
   std::string data = "";
   std::string line;
   while (std::getline(in, line)) {
     boost::algorithm::trim(line);
     if (line.size() == 0) {
       // end for an instance.
-      parse_data(data, training_data[n_train], true);
+      training_data.emplace_back();
+      parse_data(data, training_data.back(), true);
       data = "";
       ++n_train;
     } else {
@@ -157,7 +152,8 @@ void Corpus::load_training_data(const std::string& filename) {
     }
   }
   if (data.size() > 0) {
-    parse_data(data, training_data[n_train], true);
+    training_data.emplace_back();
+    parse_data(data, training_data.back(), true);
     ++n_train;
   }
 
@@ -179,12 +175,14 @@ void Corpus::load_devel_data(const std::string& filename) {
   }
 
   n_devel = 0;
+  devel_data.clear();
   std::string data = "";
   std::string line;
   while (std::getline(in, line)) {
     boost::algorithm::trim(line);
     if (line.size() == 0) {
-      parse_data(data, devel_data[n_devel], false);
+      devel_data.emplace_back();
+      parse_data(data, devel_data.back(), false);
       data = "";
       ++n_devel;
     } else {
@@ -192,7 +190,8 @@ void Corpus::load_devel_data(const std::string& filename) {
     }
   }
   if (data.size() > 0) {
-    parse_data(data, devel_data[n_devel], false);
+    devel_data.emplace_back();
+    parse_data(data, devel_data.back(), false);
     ++n_devel;
   }
 
@@ -238,6 +237,7 @@ void Corpus::parse_data(const std::string& data, Instance & inst, bool train) {
   Alphabet & char_map = AlphabetCollection::get()->char_map;
   Alphabet & pos_map = AlphabetCollection::get()->pos_map;
   Alphabet & deprel_map = AlphabetCollection::get()->deprel_map;
+  const unsigned unk = word_map.get(UNK);
 
   // dummy root at first.
   input_unit.wid = word_map.get(ROOT);
@@ -283,7 +283,7 @@ void Corpus::parse_data(const std::string& data, Instance & inst, bool train) {
         input_unit.cids.clear();
         while (cur < word.size()) {
           unsigned len = utf8_len(word[cur]);
-          input_unit.cids.push_back(char_map.insert(word.substr(cur, len)));
+          input_unit.cids.push_back(char_map.insert(StringRef(word.data() + cur, len)));
           cur += len;
         }
         inst.input_units.push_back(input_unit);
@@ -297,20 +297,12 @@ void Corpus::parse_data(const std::string& data, Instance & inst, bool train) {
         input_unit.lemma = tokens[2];
         input_unit.feature = tokens[5];
 
-        input_unit.wid = (word_map.contains(word) ? word_map.get(word) : word_map.get(UNK));
+        input_unit.wid = word_map.find_or(word, unk);
         input_unit.pid = pos_map.get(postag);
         input_unit.aux_wid = input_unit.wid;
 
-        unsigned cur = 0;
         input_unit.cids.clear();
-        while (cur < word.size()) {
-          unsigned len = utf8_len(word[cur]);
-          std::string ch_str = word.substr(cur, len);
-          input_unit.cids.push_back(
-            char_map.contains(ch_str) ? char_map.get(ch_str) : char_map.get(Corpus::UNK)
-          );
-          cur += len;
-        }
+        CharEncoder::get()->encode(word, input_unit.cids);
         inst.input_units.push_back(input_unit);
 
         parse_unit.head = boost::lexical_cast<unsigned>(tokens[6]);
@@ -330,8 +322,8 @@ void Corpus::parse_data(const std::string& data, Instance & inst, bool train) {
 }
 
 void Corpus::get_vocabulary_and_word_count() {
-  for (auto& payload : training_data) {
-    for (auto& item : payload.second.input_units) {
+  for (auto& inst : training_data) {
+    for (auto& item : inst.input_units) {
       training_vocab.insert(item.wid);
       ++counter[item.wid];
     }
@@ -51,8 +51,8 @@ struct Corpus {
   unsigned n_train;
   unsigned n_devel;
 
-  std::unordered_map<unsigned, Instance> training_data;
-  std::unordered_map<unsigned, Instance> devel_data;
+  std::vector<Instance> training_data;
+  std::vector<Instance> devel_data;
 
   std::set<unsigned> training_vocab;
   std::unordered_map<unsigned, unsigned> counter;
@@ -2,20 +2,59 @@
 #include "logging.h"
 #include "normalizer.h"
 #include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <boost/algorithm/string.hpp>
 
 namespace twpipe {
 
+namespace {
+
+struct BinaryELMoHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint32_t dim;
+  uint32_t reserved;
+  uint64_t n_entries;      // the entries follow the header directly.
+  uint64_t n_rows;
+  uint64_t values_offset;  // from the beginning of the file.
+};
+
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+inline uint64_t fnv1a(uint64_t h, const char * data, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<unsigned char>(data[i]);
+    h *= kFnvPrime;
+  }
+  return h;
+}
+
+size_t align_to(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+}
+
 ELMo * ELMo::instance = nullptr;
 
-ELMo::ELMo(): dim_(0) {
+const char* ELMo::kBinaryMagic = "TWPIPEEL";
+const unsigned ELMo::kBinaryVersion = 1;
+const unsigned ELMo::kBinaryAlignment = 64;
+
+ELMo::ELMo(): dim_(0), n_entries(0), entries(nullptr), values(nullptr) {
 }
 
 po::options_description ELMo::get_options() {
   po::options_description embed_opts("ELMo options");
   embed_opts.add_options()
-    ("elmo", po::value<std::string>(), "the path to the embedding file.")
+    ("elmo", po::value<std::string>(), "the path to the embedding file (text or binary).")
     ("elmo-dim", po::value<unsigned>()->default_value(1024), "the dimension of embedding.")
+    ("convert-elmo", po::value<std::string>(), "convert the elmo cache into the binary format and save to the path.")
     ;
   return embed_opts;
 }
@@ -27,74 +66,203 @@ ELMo * ELMo::get() {
   return instance;
 }
 
-void ELMo::load(const std::string & embedding_file, unsigned dim) {
+bool ELMo::is_binary(const std::string & embedding_file) {
+  std::ifstream ifs(embedding_file, std::ios::binary);
+  char magic[8];
+  if (!ifs.read(magic, sizeof(magic))) { return false; }
+  return std::memcmp(magic, kBinaryMagic, sizeof(magic)) == 0;
+}
+
+uint64_t ELMo::hash(const std::vector<std::string> & words) {
+  static const char period[] = "$period$";
+  static const char backslash[] = "$backslash$";
+  uint64_t h = kFnvOffset;
+  bool empty = true;
+  for (const auto & word : words) {
+    if (!empty) { h = fnv1a(h, "\t", 1); }
+    for (char ch : word) {
+      if (ch == '.') {
+        h = fnv1a(h, period, sizeof(period) - 1);
+      } else if (ch == '/') {
+        h = fnv1a(h, backslash, sizeof(backslash) - 1);
+      } else {
+        h = fnv1a(h, &ch, 1);
+      }
+    }
+    empty = (empty && word.empty());
+  }
+  return h;
+}
+
+uint64_t ELMo::hash(const std::string & key) {
+  return fnv1a(kFnvOffset, key.data(), key.size());
+}
+
+void ELMo::reset(unsigned dim) {
   dim_ = dim;
+  zeros_.assign(dim, 0.f);
+  mapped.close();
+  entries_buffer.clear();
+  values_buffer.clear();
+  n_entries = 0;
+  entries = entries_buffer.data();
+  values = values_buffer.data();
+}
+
+void ELMo::load(const std::string & embedding_file, unsigned dim) {
   _INFO << "[elmo] loading from " << embedding_file << " with " << dim << " dimensions.";
+  if (is_binary(embedding_file)) {
+    load_binary(embedding_file, dim);
+  } else {
+    load_text(embedding_file, dim);
+  }
+  _INFO << "[elmo] loaded " << n_entries << " sentences.";
+}
+
+void ELMo::load_text(const std::string & embedding_file, unsigned dim) {
+  reset(dim);
   std::ifstream ifs(embedding_file);
   BOOST_ASSERT_MSG(ifs, "Failed to load embedding file.");
   std::string line;
-  std::string word;
 
-  int cnt = 0;
-  while (true) {
-    std::getline(ifs, line);
+  while (std::getline(ifs, line)) {
     std::string key = line;
     boost::algorithm::trim(key);
     if (key.empty()) {
       break;
     }
 
-    auto & values = pretrained[key];
-    values.clear();
-    std::vector<float> v(dim, 0.f);
-    while (true) {
-      std::getline(ifs, line);
+    Entry entry;
+    entry.hash = hash(key);
+    entry.row = values_buffer.size() / dim;
+    entry.n_rows = 0;
+    while (std::getline(ifs, line)) {
       boost::algorithm::trim(line);
       if (line.empty()) {
         break;
       }
-      std::istringstream iss(line);
+      size_t offset = values_buffer.size();
+      values_buffer.resize(offset + dim, 0.f);
+      char * next = const_cast<char *>(line.c_str());
       // actually, there should be a checking about the embedding dimension.
-      for (unsigned i = 0; i < dim; ++i) { iss >> v[i]; }
-      values.push_back(v);
+      for (unsigned i = 0; i < dim; ++i) {
+        char * q = nullptr;
+        values_buffer[offset + i] = std::strtof(next, &q);
+        if (q == next) { break; }
+        next = q;
+      }
+      entry.n_rows++;
     }
-    cnt ++;
-    if (cnt % 1000 == 0) {
-      _INFO << "[elmo] loaded " << cnt
-      << " sentences, " << pretrained.size() << " entries.";
+    entries_buffer.push_back(entry);
+    if (entries_buffer.size() % 1000 == 0) {
+      _INFO << "[elmo] loaded " << entries_buffer.size() << " sentences.";
     }
   }
-  _INFO << "[elmo] loaded " << cnt
-        << " sentences, " << pretrained.size() << " entries.";
+
+  // sort by hash, the last one wins on duplicated keys.
+  std::stable_sort(entries_buffer.begin(), entries_buffer.end(),
+                   [](const Entry & a, const Entry & b) { return a.hash < b.hash; });
+  std::vector<Entry> unique_entries;
+  unique_entries.reserve(entries_buffer.size());
+  for (size_t k = 0; k < entries_buffer.size(); ++k) {
+    if (k + 1 < entries_buffer.size() && entries_buffer[k].hash == entries_buffer[k + 1].hash) { continue; }
+    unique_entries.push_back(entries_buffer[k]);
+  }
+  entries_buffer.swap(unique_entries);
+
+  n_entries = entries_buffer.size();
+  entries = entries_buffer.data();
+  values = values_buffer.data();
+}
+
+void ELMo::load_binary(const std::string & embedding_file, unsigned dim) {
+  reset(dim);
+  bool opened = mapped.open(embedding_file);
+  BOOST_ASSERT_MSG(opened, "[elmo] failed to map file.");
+  BOOST_ASSERT_MSG(mapped.size() >= sizeof(BinaryELMoHeader), "[elmo] truncated header.");
+
+  BinaryELMoHeader header;
+  std::memcpy(&header, mapped.data(), sizeof(header));
+  if (header.version != kBinaryVersion) {
+    _ERROR << "[elmo] unsupported binary elmo version " << header.version
+      << ", expected " << kBinaryVersion;
+    exit(1);
+  }
+  if (header.dim != dim) {
+    _ERROR << "[elmo] the binary elmo has " << header.dim
+      << " dimensions, but " << dim << " is specified.";
+    exit(1);
+  }
+  BOOST_ASSERT_MSG(header.alignment == kBinaryAlignment, "[elmo] mismatched alignment.");
+  BOOST_ASSERT_MSG(sizeof(header) + sizeof(Entry) * header.n_entries <= header.values_offset &&
+                   header.values_offset + sizeof(float) * header.n_rows * dim <= mapped.size(),
+                   "[elmo] truncated binary elmo.");
+
+  n_entries = header.n_entries;
+  entries = reinterpret_cast<const Entry *>(mapped.data() + sizeof(header));
+  values = reinterpret_cast<const float *>(mapped.data() + header.values_offset);
+}
+
+void ELMo::save(const std::string & embedding_file) {
+  uint64_t n_rows = 0;
+  for (size_t k = 0; k < n_entries; ++k) { n_rows += entries[k].n_rows; }
+
+  BinaryELMoHeader header;
+  std::memcpy(header.magic, kBinaryMagic, sizeof(header.magic));
+  header.version = kBinaryVersion;
+  header.alignment = kBinaryAlignment;
+  header.dim = dim_;
+  header.reserved = 0;
+  header.n_entries = n_entries;
+  header.n_rows = n_rows;
+  header.values_offset = align_to(sizeof(header) + sizeof(Entry) * n_entries, kBinaryAlignment);
+
+  // write into a temporary file, the target may be currently mapped.
+  std::string tmp_filename = embedding_file + ".tmp";
+  std::ofstream ofs(tmp_filename, std::ios::binary);
+  BOOST_ASSERT_MSG(ofs, "[elmo] failed to open file.");
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  // rows of the dropped duplicated keys are not saved, so re-number them.
+  std::vector<Entry> output_entries(entries, entries + n_entries);
+  uint64_t row = 0;
+  for (auto & entry : output_entries) {
+    entry.row = row;
+    row += entry.n_rows;
+  }
+  ofs.write(reinterpret_cast<const char *>(output_entries.data()), sizeof(Entry) * n_entries);
+  std::string padding(header.values_offset - sizeof(header) - sizeof(Entry) * n_entries, '\0');
+  ofs.write(padding.data(), padding.size());
+  for (size_t k = 0; k < n_entries; ++k) {
+    ofs.write(reinterpret_cast<const char *>(values + entries[k].row * dim_),
+              sizeof(float) * entries[k].n_rows * dim_);
+  }
+  ofs.close();
+  BOOST_ASSERT_MSG(ofs, "[elmo] failed to write file.");
+
+  if (std::rename(tmp_filename.c_str(), embedding_file.c_str()) != 0) {
+    _ERROR << "[elmo] failed to rename " << tmp_filename << " to " << embedding_file;
+    exit(1);
+  }
 }
 
 void ELMo::empty(unsigned dim) {
-  dim_ = dim;
-  _INFO << "[elmo] loaded embedding " << pretrained.size() << " entries.";
+  reset(dim);
+  _INFO << "[elmo] loaded embedding " << n_entries << " entries.";
 }
 
 void ELMo::render(const std::vector<std::string>& words,
-  std::vector<std::vector<float>>& values) {
-  std::string key;
-  for (const auto & word : words) {
-    if (key.empty()) {
-      key = word;
-    } else {
-      key.append("\t");
-      key.append(word);
-    }
-  }
-  boost::algorithm::replace_all(key, ".", "$period$");
-  boost::algorithm::replace_all(key, "/", "$backslash$");
-  auto it = pretrained.find(key);
-  if (it == pretrained.end()) {
-    _ERROR << "[elmo] key \"" << key << "\" not founded.";
-    for (int i = 0; i < words.size(); ++i) {
-      values.emplace_back(std::vector<float>(dim_, 0.f));
-    }
+  std::vector<const float *>& rows) {
+  uint64_t h = hash(words);
+  const Entry * end = entries + n_entries;
+  const Entry * it = std::lower_bound(entries, end, h,
+                                      [](const Entry & e, uint64_t key) { return e.hash < key; });
+  if (it == end || it->hash != h || it->n_rows != words.size()) {
+    _ERROR << "[elmo] key \"" << boost::algorithm::join(words, "\t") << "\" not founded.";
+    rows.insert(rows.end(), words.size(), zeros());
   } else {
-    for (const auto & val : it->second) {
-      values.push_back(val);
+    for (uint64_t i = 0; i < it->n_rows; ++i) {
+      rows.push_back(values + (it->row + i) * dim_);
     }
   }
 }
@@ -2,33 +2,85 @@
 #define __TWPIPE_ELMO_H__
 
 #include <vector>
-#include <unordered_map>
+#include <cstdint>
 #include <boost/program_options.hpp>
 #include "alphabet.h"
+#include "mapped_file.h"
 
 namespace po = boost::program_options;
 
 namespace twpipe {
 
+/**
+ * The ELMo cache maps a sentence to the rows of its tokens. It is either the
+ * text dump (a key line of tab-joined tokens, one line of values per token,
+ * then an empty line) or a binary file produced by `--convert-elmo`:
+ *
+ *   [header][entries][padding][values]
+ *
+ * Entries are sorted by the 64-bit hash of the key and give the first row
+ * and the number of rows of the sentence in the row-major float matrix,
+ * which starts on a kBinaryAlignment boundary. The binary file is mapped,
+ * and the text file is parsed into the same layout in memory.
+ */
 struct ELMo {
+  struct Entry {
+    uint64_t hash;
+    uint64_t row;
+    uint64_t n_rows;
+  };
+
 protected:
   static ELMo * instance;
-  std::unordered_map<std::string, std::vector<std::vector<float>>> pretrained;
   unsigned dim_;
+  std::vector<float> zeros_;
+
+  MappedFile mapped;
+  std::vector<Entry> entries_buffer;
+  std::vector<float> values_buffer;
+
+  size_t n_entries;
+  const Entry * entries;
+  const float * values;
 
   ELMo();
 
+  void load_text(const std::string & embedding_file, unsigned dim);
+
+  void load_binary(const std::string & embedding_file, unsigned dim);
+
+  void reset(unsigned dim);
+
 public:
+  static const char* kBinaryMagic;
+  static const unsigned kBinaryVersion;
+  static const unsigned kBinaryAlignment;
+
   static po::options_description get_options();
 
   static ELMo* get();
 
+  static bool is_binary(const std::string & embedding_file);
+
+  /// The hash of the key of the sentence, i.e. the tab-joined words with
+  /// '.' and '/' escaped, computed without building the key.
+  static uint64_t hash(const std::vector<std::string> & words);
+
+  static uint64_t hash(const std::string & key);
+
   void load(const std::string& embedding_file, unsigned dim);
 
+  void save(const std::string& embedding_file);
+
   void empty(unsigned dim);
 
+  /// Append the rows of the sentence to `values`, zero rows if the sentence
+  /// is not cached. The rows stay valid until the cache is re-loaded.
   void render(const std::vector<std::string> & words,
-              std::vector<std::vector<float>> & values);
+              std::vector<const float *> & values);
+
+  /// The shared zero row.
+  const float * zeros() const { return zeros_.data(); }
 
   unsigned dim();
 };
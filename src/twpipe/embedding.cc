@@ -1,21 +1,57 @@
 #include "embedding.h"
 #include "logging.h"
-#include "corpus.h"
 #include "normalizer.h"
 #include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 namespace twpipe {
 
+namespace {
+
+struct BinaryEmbeddingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint32_t dim;
+  uint32_t normalizer;
+  uint64_t n_words;
+  uint64_t words_offset;   // the word offsets follow the header directly.
+  uint64_t words_size;
+  uint64_t values_offset;  // from the beginning of the file.
+};
+
+size_t align_to(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+}
+
 WordEmbedding * WordEmbedding::instance = nullptr;
 
-WordEmbedding::WordEmbedding() {
+const char* WordEmbedding::kBinaryMagic = "TWPIPEEB";
+const unsigned WordEmbedding::kBinaryVersion = 1;
+const unsigned WordEmbedding::kBinaryAlignment = 64;
+const size_t WordEmbedding::kMaxRenderCacheSize = 1 << 20;
+
+WordEmbedding::WordEmbedding() :
+  normalizer_type(kNone),
+  dim_(0),
+  n_words(0),
+  word_offsets(nullptr),
+  words(nullptr),
+  values(nullptr) {
 }
 
 po::options_description WordEmbedding::get_options() {
   po::options_description embed_opts("Embedding options");
   embed_opts.add_options()
-    ("embedding", po::value<std::string>(), "the path to the embedding file.")
+    ("embedding", po::value<std::string>(), "the path to the embedding file (text or binary).")
     ("embedding-dim", po::value<unsigned>()->default_value(100), "the dimension of embedding.")
+    ("convert-embedding", po::value<std::string>(), "convert the embedding into the binary format and save to the path.")
     ;
   return embed_opts;
 }
@@ -27,61 +63,225 @@ WordEmbedding * WordEmbedding::get() {
   return instance;
 }
 
-void WordEmbedding::load(const std::string & embedding_file, unsigned dim) {
+bool WordEmbedding::is_binary(const std::string & embedding_file) {
+  std::ifstream ifs(embedding_file, std::ios::binary);
+  char magic[8];
+  if (!ifs.read(magic, sizeof(magic))) { return false; }
+  return std::memcmp(magic, kBinaryMagic, sizeof(magic)) == 0;
+}
+
+void WordEmbedding::reset(unsigned dim) {
   dim_ = dim;
-  size_t found = embedding_file.find("glove");
   normalizer_type = kNone;
-  if (found != std::string::npos) { normalizer_type = kGlove; }
-  pretrained[Corpus::BAD0] = std::vector<float>(dim, 0.f);
-  pretrained[Corpus::UNK] = std::vector<float>(dim, 0.f);
-  pretrained[Corpus::ROOT] = std::vector<float>(dim, 0.f);
+  mapped.close();
+  word_offsets_buffer.assign(1, 0);
+  words_buffer.clear();
+  values_buffer.clear();
+  n_words = 0;
+  word_offsets = word_offsets_buffer.data();
+  words = words_buffer.data();
+  values = values_buffer.data();
+  zeros.assign(dim, 0.f);
+  render_cache.clear();
+}
+
+void WordEmbedding::load(const std::string & embedding_file, unsigned dim) {
   _INFO << "[embedding] loading from " << embedding_file << " with " << dim << " dimensions.";
-  std::ifstream ifs(embedding_file);
-  BOOST_ASSERT_MSG(ifs, "Failed to load embedding file.");
-  std::string line;
-  // get the header in word2vec styled embedding.
-  std::getline(ifs, line);
-  std::vector<float> v(dim, 0.f);
-  std::string word;
-  while (std::getline(ifs, line)) {
-    std::istringstream iss(line);
-    iss >> word;
-    // actually, there should be a checking about the embedding dimension.
-    for (unsigned i = 0; i < dim; ++i) { iss >> v[i]; }
-    pretrained[word] = v;
+  if (is_binary(embedding_file)) {
+    load_binary(embedding_file, dim);
+  } else {
+    load_text(embedding_file, dim);
   }
   std::string normalizer_type_name = "none";
   if (normalizer_type == kGlove) { normalizer_type_name = "glove"; }
   _INFO << "[embedding] normalizer type: " << normalizer_type_name;
-  _INFO << "[embedding] loaded embedding " << pretrained.size() << " entries.";
+  _INFO << "[embedding] loaded embedding " << n_words << " entries.";
+}
+
+void WordEmbedding::load_text(const std::string & embedding_file, unsigned dim) {
+  reset(dim);
+  size_t found = embedding_file.find("glove");
+  if (found != std::string::npos) { normalizer_type = kGlove; }
+
+  std::ifstream ifs(embedding_file);
+  BOOST_ASSERT_MSG(ifs, "Failed to load embedding file.");
+
+  std::vector<std::string> file_words;
+  std::vector<float> file_values;
+  std::string line;
+  unsigned n_malformed = 0;
+  for (bool first = true; std::getline(ifs, line); first = false) {
+    const char * p = line.c_str();
+    const char * end = std::strchr(p, ' ');
+    if (end == nullptr || end == p) { continue; }
+    // skip the `n_words dim' header of the word2vec styled embedding.
+    if (first && std::strchr(end + 1, ' ') == nullptr) { continue; }
+
+    size_t row = file_values.size();
+    file_values.resize(row + dim);
+    char * next = const_cast<char *>(end);
+    unsigned i = 0;
+    for (; i < dim; ++i) {
+      char * q = nullptr;
+      file_values[row + i] = std::strtof(next, &q);
+      if (q == next) { break; }
+      next = q;
+    }
+    if (i < dim) {
+      file_values.resize(row);
+      ++n_malformed;
+      continue;
+    }
+    file_words.emplace_back(p, end);
+  }
+  if (n_malformed > 0) {
+    _WARN << "[embedding] skipped " << n_malformed << " lines with less than " << dim << " values.";
+  }
+
+  // sort the vocabulary, the last one wins on duplicated words.
+  std::vector<size_t> order(file_words.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&file_words](size_t a, size_t b) { return file_words[a] < file_words[b]; });
+  std::vector<size_t> unique_order;
+  unique_order.reserve(order.size());
+  for (size_t k = 0; k < order.size(); ++k) {
+    if (k + 1 < order.size() && file_words[order[k]] == file_words[order[k + 1]]) { continue; }
+    unique_order.push_back(order[k]);
+  }
+
+  n_words = unique_order.size();
+  word_offsets_buffer.resize(n_words + 1);
+  values_buffer.resize(n_words * dim);
+  for (size_t k = 0; k < n_words; ++k) {
+    size_t j = unique_order[k];
+    word_offsets_buffer[k] = words_buffer.size();
+    words_buffer += file_words[j];
+    std::memcpy(values_buffer.data() + k * dim, file_values.data() + j * dim, sizeof(float) * dim);
+  }
+  word_offsets_buffer[n_words] = words_buffer.size();
+
+  word_offsets = word_offsets_buffer.data();
+  words = words_buffer.data();
+  values = values_buffer.data();
+}
+
+void WordEmbedding::load_binary(const std::string & embedding_file, unsigned dim) {
+  reset(dim);
+  bool opened = mapped.open(embedding_file);
+  BOOST_ASSERT_MSG(opened, "[embedding] failed to map file.");
+  BOOST_ASSERT_MSG(mapped.size() >= sizeof(BinaryEmbeddingHeader), "[embedding] truncated header.");
+
+  BinaryEmbeddingHeader header;
+  std::memcpy(&header, mapped.data(), sizeof(header));
+  if (header.version != kBinaryVersion) {
+    _ERROR << "[embedding] unsupported binary embedding version " << header.version
+      << ", expected " << kBinaryVersion;
+    exit(1);
+  }
+  if (header.dim != dim) {
+    _ERROR << "[embedding] the binary embedding has " << header.dim
+      << " dimensions, but " << dim << " is specified.";
+    exit(1);
+  }
+  BOOST_ASSERT_MSG(header.alignment == kBinaryAlignment, "[embedding] mismatched alignment.");
+  BOOST_ASSERT_MSG(header.words_offset + header.words_size <= header.values_offset &&
+                   header.values_offset + sizeof(float) * header.n_words * dim <= mapped.size(),
+                   "[embedding] truncated binary embedding.");
+
+  normalizer_type = static_cast<NORMALIZER_TYPE>(header.normalizer);
+  n_words = header.n_words;
+  word_offsets = reinterpret_cast<const uint64_t *>(mapped.data() + sizeof(header));
+  words = mapped.data() + header.words_offset;
+  values = reinterpret_cast<const float *>(mapped.data() + header.values_offset);
+}
+
+void WordEmbedding::save(const std::string & embedding_file) {
+  BinaryEmbeddingHeader header;
+  std::memcpy(header.magic, kBinaryMagic, sizeof(header.magic));
+  header.version = kBinaryVersion;
+  header.alignment = kBinaryAlignment;
+  header.dim = dim_;
+  header.normalizer = normalizer_type;
+  header.n_words = n_words;
+  header.words_offset = sizeof(header) + sizeof(uint64_t) * (n_words + 1);
+  header.words_size = word_offsets[n_words];
+  header.values_offset = align_to(header.words_offset + header.words_size, kBinaryAlignment);
+
+  // write into a temporary file, the target may be currently mapped.
+  std::string tmp_filename = embedding_file + ".tmp";
+  std::ofstream ofs(tmp_filename, std::ios::binary);
+  BOOST_ASSERT_MSG(ofs, "[embedding] failed to open file.");
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.write(reinterpret_cast<const char *>(word_offsets), sizeof(uint64_t) * (n_words + 1));
+  ofs.write(words, header.words_size);
+  std::string padding(header.values_offset - header.words_offset - header.words_size, '\0');
+  ofs.write(padding.data(), padding.size());
+  ofs.write(reinterpret_cast<const char *>(values), sizeof(float) * n_words * dim_);
+  ofs.close();
+  BOOST_ASSERT_MSG(ofs, "[embedding] failed to write file.");
+
+  if (std::rename(tmp_filename.c_str(), embedding_file.c_str()) != 0) {
+    _ERROR << "[embedding] failed to rename " << tmp_filename << " to " << embedding_file;
+    exit(1);
+  }
 }
 
 void WordEmbedding::empty(unsigned dim) {
-  dim_ = dim;
-  normalizer_type = kNone;
-  pretrained[Corpus::BAD0] = std::vector<float>(dim, 0.f);
-  pretrained[Corpus::UNK] = std::vector<float>(dim, 0.f);
-  pretrained[Corpus::ROOT] = std::vector<float>(dim, 0.f);
-  _INFO << "[embedding] loaded embedding " << pretrained.size() << " entries.";
+  reset(dim);
+  _INFO << "[embedding] loaded embedding " << n_words << " entries.";
+}
+
+const float * WordEmbedding::lookup(const std::string & word) const {
+  size_t lo = 0, hi = n_words;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const char * begin = words + word_offsets[mid];
+    size_t len = word_offsets[mid + 1] - word_offsets[mid];
+    int cmp = std::memcmp(begin, word.data(), std::min(len, word.size()));
+    if (cmp == 0) { cmp = (len < word.size() ? -1 : (len > word.size() ? 1 : 0)); }
+    if (cmp == 0) { return values + mid * dim_; }
+    if (cmp < 0) { lo = mid + 1; } else { hi = mid; }
+  }
+  return nullptr;
 }
 
 void WordEmbedding::render(const std::vector<std::string>& words,
-                           std::vector<std::vector<float>>& values) {
-  values.clear();
+                           std::vector<const float *>& values) {
   for (const auto & word : words) {
-    std::string normalized_word = word;
-    if (normalizer_type == kGlove) {
-      normalized_word = GloveNormalizer::normalize(normalized_word);
+    auto it = render_cache.find(word);
+    if (it != render_cache.end()) {
+      values.push_back(it->second);
+      continue;
     }
-    auto it = pretrained.find(normalized_word);
-    values.push_back(it == pretrained.end() ?
-                     std::vector<float>(dim_, 0.f) :
-                     it->second);
+    const float * value = (normalizer_type == kGlove ?
+                           lookup(GloveNormalizer::normalize(word)) :
+                           lookup(word));
+    if (value == nullptr) { value = zeros.data(); }
+    if (render_cache.size() >= kMaxRenderCacheSize) { render_cache.clear(); }
+    render_cache[word] = value;
+    values.push_back(value);
   }
 }
 
+void WordEmbedding::input(dynet::ComputationGraph & cg,
+                          unsigned dim,
+                          const std::vector<const float *> & rows,
+                          std::vector<dynet::Expression> & exprs) {
+  unsigned n = rows.size();
+  exprs.resize(n);
+  if (n == 0) { return; }
+  std::vector<float> data(dim * n);
+  for (unsigned i = 0; i < n; ++i) {
+    std::memcpy(data.data() + i * dim, rows[i], sizeof(float) * dim);
+  }
+  // column-major, so the i-th row becomes the i-th column.
+  dynet::Expression matrix = dynet::input(cg, dynet::Dim({ dim, n }), data);
+  for (unsigned i = 0; i < n; ++i) { exprs[i] = dynet::pick(matrix, i, 1); }
+}
+
 unsigned WordEmbedding::dim() {
   return dim_;
 }
 
-}
\ No newline at end of file
+}
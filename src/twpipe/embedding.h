@@ -2,37 +2,95 @@
 #define __TWPIPE_EMBEDDING_H__
 
 #include <vector>
+#include <cstdint>
 #include <unordered_map>
 #include <boost/program_options.hpp>
+#include "dynet/expr.h"
 #include "alphabet.h"
+#include "mapped_file.h"
 
 namespace po = boost::program_options;
 
 namespace twpipe {
 
+/**
+ * The pretrained embedding is either a word2vec/GloVe text file or a binary
+ * file produced by `--convert-embedding`:
+ *
+ *   [header][word offsets][words][padding][values]
+ *
+ * Words are sorted bytewise and concatenated, the (n_words + 1) offsets
+ * delimit them, and values is a row-major n_words x dim float matrix
+ * starting on a kBinaryAlignment boundary. The binary file is mapped, so
+ * loading is instant and the pages are shared between processes. The text
+ * file is parsed into the same layout in memory.
+ */
 struct WordEmbedding {
 protected:
   enum NORMALIZER_TYPE { kNone, kGlove };
   static WordEmbedding * instance;
-  std::unordered_map<std::string, std::vector<float>> pretrained;
   NORMALIZER_TYPE normalizer_type;
   unsigned dim_;
 
+  MappedFile mapped;
+  std::vector<uint64_t> word_offsets_buffer;
+  std::string words_buffer;
+  std::vector<float> values_buffer;
+
+  size_t n_words;
+  const uint64_t * word_offsets;
+  const char * words;
+  const float * values;
+
+  // the shared row of out-of-vocabulary words.
+  std::vector<float> zeros;
+  // the rows of the rendered words, saves normalizing and searching again.
+  std::unordered_map<std::string, const float *> render_cache;
+
   WordEmbedding();
 
+  void load_text(const std::string & embedding_file, unsigned dim);
+
+  void load_binary(const std::string & embedding_file, unsigned dim);
+
+  void reset(unsigned dim);
+
 public:
+  static const char* kBinaryMagic;
+  static const unsigned kBinaryVersion;
+  static const unsigned kBinaryAlignment;
+  static const size_t kMaxRenderCacheSize;
+
   static po::options_description get_options();
 
   static WordEmbedding* get();
 
+  static bool is_binary(const std::string & embedding_file);
+
   void load(const std::string& embedding_file, unsigned dim);
 
+  void save(const std::string& embedding_file);
+
   void empty(unsigned dim);
 
+  /// The vector of the (unnormalized) word, nullptr if not found.
+  const float * lookup(const std::string & word) const;
+
+  /// Append the rows of the words to `values`. The rows point into the
+  /// embedding storage and stay valid until it is re-loaded.
   void render(const std::vector<std::string> & words,
-              std::vector<std::vector<float>> & values);
+              std::vector<const float *> & values);
+
+  /// Feed the rows into the graph as a single dim x n input, and get one
+  /// column expression per row.
+  static void input(dynet::ComputationGraph & cg,
+                    unsigned dim,
+                    const std::vector<const float *> & rows,
+                    std::vector<dynet::Expression> & exprs);
 
   unsigned dim();
+
+  size_t size() const { return n_words; }
 };
 
 }
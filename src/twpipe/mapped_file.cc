@@ -0,0 +1,45 @@
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace twpipe {
+
+MappedFile::MappedFile() : data_(nullptr), size_(0) {
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const std::string & filename) {
+  close();
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) { return false; }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the descriptor is closed.
+  ::close(fd);
+  if (addr == MAP_FAILED) { return false; }
+
+  data_ = static_cast<const char *>(addr);
+  size_ = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
+
+}
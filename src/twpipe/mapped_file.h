@@ -0,0 +1,34 @@
+#ifndef __TWPIPE_MAPPED_FILE_H__
+#define __TWPIPE_MAPPED_FILE_H__
+
+#include <iostream>
+
+namespace twpipe {
+
+// A read-only memory mapping of a whole file. The mapping is released
+// when the object is destroyed or re-opened.
+class MappedFile {
+  const char * data_;
+  size_t size_;
+
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator = (const MappedFile &) = delete;
+
+  bool open(const std::string & filename);
+
+  void close();
+
+  bool is_open() const { return data_ != nullptr; }
+
+  const char * data() const { return data_; }
+
+  size_t size() const { return size_; }
+};
+
+}
+
+#endif  //  end for __TWPIPE_MAPPED_FILE_H__
@@ -16,3 +16,51 @@ unsigned twpipe::Math::distribution_sample(const std::vector<float>& prob,
   std::discrete_distribution<unsigned> distrib(prob.begin(), prob.end());
   return distrib(gen);
 }
+
+void twpipe::Math::viterbi(const float * emit,
+                           const std::vector<float>& tran,
+                           unsigned n,
+                           unsigned T,
+                           unsigned start,
+                           std::vector<unsigned>& output) {
+  output.resize(n);
+  if (n == 0) { return; }
+
+  // transpose so that the inner loop over previous tags is contiguous.
+  std::vector<float> tran_t(T * T);
+  for (unsigned pt = 0; pt < T; ++pt) {
+    for (unsigned t = 0; t < T; ++t) { tran_t[t * T + pt] = tran[pt * T + t]; }
+  }
+
+  std::vector<float> alpha(T), next_alpha(T), scores(T);
+  std::vector<unsigned> path(n * T, start);
+  for (unsigned t = 0; t < T; ++t) { alpha[t] = emit[t] + tran[start * T + t]; }
+
+  for (unsigned i = 1; i < n; ++i) {
+    const float * e = emit + i * T;
+    for (unsigned t = 0; t < T; ++t) {
+      const float * row = &tran_t[t * T];
+      float best = alpha[0] + row[0];
+      for (unsigned pt = 0; pt < T; ++pt) {
+        scores[pt] = alpha[pt] + row[pt];
+        best = (scores[pt] > best ? scores[pt] : best);
+      }
+      // the first maximum wins, the same as a strict comparison.
+      unsigned best_pt = 0;
+      while (scores[best_pt] != best) { ++best_pt; }
+      next_alpha[t] = best + e[t];
+      path[i * T + t] = best_pt;
+    }
+    alpha.swap(next_alpha);
+  }
+
+  unsigned best = 0;
+  for (unsigned t = 1; t < T; ++t) {
+    if (alpha[best] < alpha[t]) { best = t; }
+  }
+  output[n - 1] = best;
+  for (unsigned i = n - 1; i > 0; --i) {
+    best = path[i * T + best];
+    output[i - 1] = best;
+  }
+}
@@ -11,6 +11,21 @@ struct Math {
 
   static unsigned distribution_sample(const std::vector<float>& prob,
                                       std::mt19937& gen);
+
+  /**
+   * Max-plus decoding over a first-order chain.
+   *
+   * @param emit    n x T emission scores, row major.
+   * @param tran    T x T transition scores, indexed by prev * T + curr.
+   * @param start   the tag before the first position.
+   * @param output  the best tag sequence.
+   */
+  static void viterbi(const float * emit,
+                      const std::vector<float>& tran,
+                      unsigned n,
+                      unsigned T,
+                      unsigned start,
+                      std::vector<unsigned>& output);
 };
 
 }
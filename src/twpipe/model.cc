@@ -1,18 +1,62 @@
 #include "model.h"
+#include "logging.h"
+#include "dynet/tensor.h"
+#include "dynet/devices.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
 #include <fstream>
 #include <boost/algorithm/string.hpp>
 
 namespace twpipe {
 
+namespace {
+
+struct BinaryModelHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint64_t meta_size;    // the meta json follows the header directly.
+  uint64_t data_offset;  // from the beginning of the file.
+  uint64_t data_size;
+};
+
+size_t align_to(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+void write_padding(std::ofstream & ofs, size_t n) {
+  static const char zeros[64] = { 0 };
+  while (n > 0) {
+    size_t m = (n < sizeof(zeros) ? n : sizeof(zeros));
+    ofs.write(zeros, m);
+    n -= m;
+  }
+}
+
+void set_tensor(dynet::Tensor & tensor, const float * values, unsigned n) {
+  if (tensor.device->type == dynet::DeviceType::CPU) {
+    std::memcpy(tensor.v, values, sizeof(float) * n);
+  } else {
+    dynet::TensorTools::set_elements(tensor, std::vector<float>(values, values + n));
+  }
+}
+
+}
+
 const char* Model::kGeneral = "general";
 const char* Model::kTokenizerName = "tokenizer";
 const char* Model::kSentenceSegmentAndTokenizeName = "sentsegmentor_and_tokenizer";
 const char* Model::kPostaggerName = "postagger";
 const char* Model::kParserName = "parser";
 
+const char* Model::kBinaryMagic = "TWPIPEMB";
+const unsigned Model::kBinaryVersion = 1;
+const unsigned Model::kBinaryAlignment = 64;
+
 Model* Model::instance = nullptr;
 
-Model::Model() {
+Model::Model() : data_offset(0) {
   payload[kSentenceSegmentAndTokenizeName] = nullptr;
   payload[kTokenizerName] = nullptr;
   payload[kPostaggerName] = nullptr;
@@ -23,6 +67,8 @@ po::options_description Model::get_options() {
   po::options_description model_opts("Model options");
   model_opts.add_options()
     ("model", po::value<std::string>(), "model file")
+    ("model-format", po::value<std::string>()->default_value("binary"), "the format of saved model [binary|json].")
+    ("convert-model", po::value<std::string>(), "convert the model (json or binary) to the binary format and save it to this path.")
     ;
   return model_opts;
 }
@@ -35,17 +81,145 @@ Model * Model::get() {
 }
 
 void Model::save(const std::string & filename) {
+  const char * phases[] = {
+    kTokenizerName, kSentenceSegmentAndTokenizeName, kPostaggerName, kParserName
+  };
+
+  // first pass: assign offsets and strip values from the meta.
+  nlohmann::json meta = payload;
+  size_t data_size = 0;
+  for (const char * phase : phases) {
+    if (meta[phase].is_null() || meta[phase].count("model") == 0) { continue; }
+    auto & json = meta[phase]["model"];
+    for (auto it = json.begin(); it != json.end(); ++it) {
+      unsigned dim = it.value()["dim"];
+      it.value().erase("value");
+      it.value()["offset"] = data_size;
+      data_size += align_to(sizeof(float) * dim, kBinaryAlignment);
+    }
+  }
+  std::string meta_str = meta.dump();
+
+  BinaryModelHeader header;
+  std::memcpy(header.magic, kBinaryMagic, sizeof(header.magic));
+  header.version = kBinaryVersion;
+  header.alignment = kBinaryAlignment;
+  header.meta_size = meta_str.size();
+  header.data_offset = align_to(sizeof(header) + meta_str.size(), kBinaryAlignment);
+  header.data_size = data_size;
+
+  // write into a temporary file, the target may be currently mapped.
+  std::string tmp_filename = filename + ".tmp";
+  std::ofstream ofs(tmp_filename, std::ios::binary);
+  BOOST_ASSERT_MSG(ofs, "[model] failed to open file.");
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.write(meta_str.data(), meta_str.size());
+  write_padding(ofs, header.data_offset - sizeof(header) - meta_str.size());
+
+  // second pass: dump the tensors in the same order.
+  for (const char * phase : phases) {
+    if (meta[phase].is_null() || meta[phase].count("model") == 0) { continue; }
+    const auto & json = payload[phase]["model"];
+    for (auto it = json.begin(); it != json.end(); ++it) {
+      unsigned dim = it.value()["dim"];
+      size_t n_bytes = sizeof(float) * dim;
+      if (it.value().count("value")) {
+        std::vector<float> values = it.value()["value"].get<std::vector<float>>();
+        BOOST_ASSERT_MSG(values.size() == dim, "[model] mismatch dimension when saving.");
+        ofs.write(reinterpret_cast<const char *>(values.data()), n_bytes);
+      } else {
+        ofs.write(reinterpret_cast<const char *>(mapped_tensor(it.value())), n_bytes);
+      }
+      write_padding(ofs, align_to(n_bytes, kBinaryAlignment) - n_bytes);
+    }
+  }
+  ofs.close();
+  BOOST_ASSERT_MSG(ofs, "[model] failed to write file.");
+
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    _ERROR << "[model] failed to rename " << tmp_filename << " to " << filename;
+    exit(1);
+  }
+}
+
+void Model::save_json(const std::string & filename) {
+  const char * phases[] = {
+    kTokenizerName, kSentenceSegmentAndTokenizeName, kPostaggerName, kParserName
+  };
+
+  // tensors from a binary model are materialized before dumping.
+  nlohmann::json output = payload;
+  for (const char * phase : phases) {
+    if (output[phase].is_null() || output[phase].count("model") == 0) { continue; }
+    auto & json = output[phase]["model"];
+    for (auto it = json.begin(); it != json.end(); ++it) {
+      if (it.value().count("offset") == 0) { continue; }
+      unsigned dim = it.value()["dim"];
+      const float * values = mapped_tensor(it.value());
+      it.value()["value"] = std::vector<float>(values, values + dim);
+      it.value().erase("offset");
+    }
+  }
+
   std::ofstream ofs(filename);
   BOOST_ASSERT_MSG(ofs, "[model] failed to open file.");
-  ofs << payload;
+  ofs << output;
 }
 
 void Model::load(const std::string & filename) {
+  if (is_binary(filename)) {
+    load_binary(filename);
+  } else {
+    load_json(filename);
+  }
+}
+
+bool Model::is_binary(const std::string & filename) {
+  std::ifstream ifs(filename, std::ios::binary);
+  char magic[8];
+  if (!ifs.read(magic, sizeof(magic))) { return false; }
+  return std::memcmp(magic, kBinaryMagic, sizeof(magic)) == 0;
+}
+
+void Model::load_json(const std::string & filename) {
+  mapped.close();
+  data_offset = 0;
   std::ifstream ifs(filename);
   BOOST_ASSERT_MSG(ifs, "[model] failed to open file.");
   ifs >> payload;
 }
 
+void Model::load_binary(const std::string & filename) {
+  bool opened = mapped.open(filename);
+  BOOST_ASSERT_MSG(opened, "[model] failed to map file.");
+  BOOST_ASSERT_MSG(mapped.size() >= sizeof(BinaryModelHeader), "[model] truncated header.");
+
+  BinaryModelHeader header;
+  std::memcpy(&header, mapped.data(), sizeof(header));
+  if (header.version != kBinaryVersion) {
+    _ERROR << "[model] unsupported binary model version " << header.version
+      << ", expected " << kBinaryVersion;
+    exit(1);
+  }
+  BOOST_ASSERT_MSG(header.alignment == kBinaryAlignment, "[model] mismatched alignment.");
+  BOOST_ASSERT_MSG(sizeof(header) + header.meta_size <= header.data_offset &&
+                   header.data_offset + header.data_size <= mapped.size(),
+                   "[model] truncated binary model.");
+
+  const char * meta_begin = mapped.data() + sizeof(header);
+  payload = nlohmann::json::parse(meta_begin, meta_begin + header.meta_size);
+  data_offset = header.data_offset;
+}
+
+const float * Model::mapped_tensor(const nlohmann::json & entry) const {
+  BOOST_ASSERT_MSG(mapped.is_open(), "[model] tensor offset without mapped model.");
+  size_t offset = entry["offset"].get<size_t>();
+  size_t dim = entry["dim"].get<size_t>();
+  BOOST_ASSERT_MSG(data_offset + offset + sizeof(float) * dim <= mapped.size(),
+                   "[model] tensor out of range.");
+  return reinterpret_cast<const float *>(mapped.data() + data_offset + offset);
+}
+
 void Model::to_json(const std::string & phase_name,
                     const std::vector<StrConfigItemType>& str_conf) {
   if (!valid_phase_name(phase_name)) {
@@ -59,9 +233,12 @@ void Model::to_json(const std::string & phase_name,
 void Model::to_json(const std::string & name,
                     const Alphabet & alphabet) {
   auto & json = payload[kGeneral][name];
-  const auto & str_to_id = alphabet.str_to_id;
-  for (const auto & it : str_to_id) {
-    json[it.first] = it.second;
+  for (unsigned id = 0; id < alphabet.size(); ++id) {
+    if (!alphabet.contains(id)) { continue; }
+    StringRef str = alphabet.get_ref(id);
+    // skip the ids whose string is re-assigned to another id.
+    if (alphabet.find_or(str, Alphabet::kNone) != id) { continue; }
+    json[str.str()] = id;
   }
 }
 
@@ -73,13 +250,16 @@ void Model::to_json(const std::string & phase_name,
 
   const dynet::ParameterCollectionStorage & storage = model.get_storage();
   auto & json = payload[phase_name]["model"];
+  // a tensor loaded from a binary model is replaced by the written value.
   for (auto & p : storage.params) { 
     json[p->name]["dim"] = p->dim.size();
     json[p->name]["value"] = dynet::as_vector(p->values);
+    json[p->name].erase("offset");
   }
   for (auto & p : storage.lookup_params) {
     json[p->name]["dim"] = p->all_dim.size();
     json[p->name]["value"] = dynet::as_vector(p->all_values);
+    json[p->name].erase("offset");
   }
 }
 
@@ -98,6 +278,15 @@ void Model::from_json(const std::string & name, Alphabet & alphabet) {
   for (auto it = json.begin(); it != json.end(); ++it) {
     alphabet.insert(it.key(), it.value());
   }
+  // every string should still be found after the others were inserted, even
+  // if the model gives the same id to several strings.
+  for (auto it = json.begin(); it != json.end(); ++it) {
+    unsigned id = it.value();
+    if (alphabet.find_or(it.key(), Alphabet::kNone) != id) {
+      _ERROR << "[model] " << name << " lost \"" << it.key() << "\" (" << id << ") when loading.";
+      exit(1);
+    }
+  }
 }
 
 void Model::from_json(const std::string & phase_name,
@@ -111,16 +300,24 @@ void Model::from_json(const std::string & phase_name,
   for (auto & p : storage.params) {
     unsigned dim = json[p->name]["dim"];
     BOOST_ASSERT_MSG(p->dim.size() == dim, "[model] mismatch dimension when loading.");
-    std::vector<float> values(dim);
-    values = json[p->name]["value"].get<std::vector<float>>();
-    dynet::TensorTools::set_elements(p->values, values);
+    if (json[p->name].count("offset")) {
+      set_tensor(p->values, mapped_tensor(json[p->name]), dim);
+    } else {
+      std::vector<float> values(dim);
+      values = json[p->name]["value"].get<std::vector<float>>();
+      dynet::TensorTools::set_elements(p->values, values);
+    }
   }
   for (auto & p : storage.lookup_params) {
     unsigned dim = json[p->name]["dim"];
     BOOST_ASSERT_MSG(p->all_dim.size() == dim, "[model] mismatch dimension when loading.");
-    std::vector<float> values(dim);
-    values = json[p->name]["value"].get<std::vector<float>>();
-    dynet::TensorTools::set_elements(p->all_values, values);
+    if (json[p->name].count("offset")) {
+      set_tensor(p->all_values, mapped_tensor(json[p->name]), dim);
+    } else {
+      std::vector<float> values(dim);
+      values = json[p->name]["value"].get<std::vector<float>>();
+      dynet::TensorTools::set_elements(p->all_values, values);
+    }
   }
 }
 
@@ -5,6 +5,7 @@
 #include <boost/program_options.hpp>
 #include "dynet/model.h"
 #include "alphabet.h"
+#include "mapped_file.h"
 #include "json.hpp"
 
 namespace po = boost::program_options;
@@ -14,13 +15,32 @@ namespace twpipe {
 typedef std::pair<std::string, std::string> StrConfigItemType;
 typedef std::pair<std::string, unsigned> IntConfigItemType;
 
+/**
+ * The model is either a plain JSON file or a binary container:
+ *
+ *   [header][meta json][padding][tensor 0][padding][tensor 1]...
+ *
+ * The meta json holds the configs and alphabets. For each parameter, it
+ * stores the dim and the byte offset of its values in the data section
+ * instead of the values themselves. Every tensor starts on a
+ * kBinaryAlignment boundary, so the file is mapped and tensors are copied
+ * directly into the parameters without parsing text.
+ */
 class Model {
 protected:
   nlohmann::json payload;
+  MappedFile mapped;
+  size_t data_offset;
   static Model * instance;
 
   Model();
 
+  void load_binary(const std::string & filename);
+
+  void load_json(const std::string & filename);
+
+  const float * mapped_tensor(const nlohmann::json & entry) const;
+
 public:
   static const char* kGeneral;
   static const char* kTokenizerName;
@@ -28,14 +48,25 @@ public:
   static const char* kPostaggerName;
   static const char* kParserName;
 
+  static const char* kBinaryMagic;
+  static const unsigned kBinaryVersion;
+  static const unsigned kBinaryAlignment;
+
   static po::options_description get_options();
 
   static Model * get();
 
+  /// Save in the binary format.
   void save(const std::string & filename);
 
+  /// Save in the legacy JSON format.
+  void save_json(const std::string & filename);
+
+  /// Load either format, detected by the magic bytes.
   void load(const std::string & filename);
 
+  static bool is_binary(const std::string & filename);
+
   void to_json(const std::string & phase_name,
                const std::vector<StrConfigItemType> & str_conf);
 
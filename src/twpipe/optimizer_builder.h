@@ -34,6 +34,10 @@ struct OptimizerBuilder {
   dynet::Trainer * build(dynet::ParameterCollection & model);
 
   void update(dynet::Trainer * trainer, unsigned iter);
+
+  /// Whether the optimizer keeps per-parameter states (moments, accumulated
+  /// gradients) besides the learning rate.
+  bool is_stateful() const { return optimizer_type != kSimpleSGD; }
 };
 
 }
@@ -0,0 +1,254 @@
+#include "parallel.h"
+#include "logging.h"
+#include "dynet/dynet.h"
+#include "dynet/tensor.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <boost/assert.hpp>
+
+namespace twpipe {
+
+bool ParallelUtils::write_all(int fd, const char * data, size_t n) {
+  while (n > 0) {
+    ssize_t ret = write(fd, data, n);
+    if (ret < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    data += ret;
+    n -= ret;
+  }
+  return true;
+}
+
+bool ParallelUtils::read_all(int fd, char * data, size_t n) {
+  while (n > 0) {
+    ssize_t ret = read(fd, data, n);
+    if (ret < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    if (ret == 0) { return false; }
+    data += ret;
+    n -= ret;
+  }
+  return true;
+}
+
+namespace {
+
+void run_worker(const std::string & filename,
+                unsigned worker_id,
+                unsigned n_workers,
+                const LineProcessor & processor,
+                int fd) {
+  std::ifstream ifs(filename);
+  std::string buffer;
+  for (unsigned idx = 0; std::getline(ifs, buffer); ++idx) {
+    if (idx % n_workers != worker_id) { continue; }
+    std::ostringstream oss;
+    processor(buffer, oss);
+    const std::string & output = oss.str();
+    uint64_t size = output.size();
+    if (!ParallelUtils::write_all(fd, reinterpret_cast<const char *>(&size), sizeof(size)) ||
+        !ParallelUtils::write_all(fd, output.data(), output.size())) {
+      _exit(1);
+    }
+  }
+}
+
+}
+
+bool ParallelUtils::fork_workers(unsigned n_workers,
+                                 const std::function<void(unsigned worker_id)> & work,
+                                 const std::function<void()> & supervise) {
+  BOOST_ASSERT_MSG(n_workers > 0, "[parallel] number of workers should be positive.");
+  // the buffered output would otherwise be written by every worker again.
+  std::cout.flush();
+  std::cerr.flush();
+
+  std::vector<pid_t> pids(n_workers);
+  for (unsigned k = 0; k < n_workers; ++k) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      _ERROR << "[parallel] failed to fork worker #" << k;
+      exit(1);
+    }
+    if (pid == 0) {
+      work(k);
+      _exit(0);
+    }
+    pids[k] = pid;
+  }
+
+  if (supervise) { supervise(); }
+
+  bool succeeded = true;
+  for (unsigned k = 0; k < n_workers; ++k) {
+    int status = 0;
+    waitpid(pids[k], &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      _ERROR << "[parallel] worker #" << k << " exited abnormally.";
+      succeeded = false;
+    }
+  }
+  return succeeded;
+}
+
+namespace {
+
+/// A zero-filled mapping of n floats shared with the forked workers.
+float * map_shared(size_t n) {
+  size_t n_bytes = n * sizeof(float);
+  void * mapped = mmap(nullptr, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    _ERROR << "[parallel] failed to map " << n_bytes << " bytes for the workers.";
+    exit(1);
+  }
+  return static_cast<float *>(mapped);
+}
+
+void unmap_shared(float * mapped, size_t n) {
+  munmap(mapped, n * sizeof(float));
+}
+
+}
+
+void ParallelUtils::process_lines(const std::string & filename,
+                                  unsigned n_workers,
+                                  const LineProcessor & processor,
+                                  std::ostream & os) {
+  BOOST_ASSERT_MSG(n_workers > 0, "[parallel] number of workers should be positive.");
+  os.flush();
+
+  std::vector<int> read_fds(n_workers), write_fds(n_workers);
+  for (unsigned k = 0; k < n_workers; ++k) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+      _ERROR << "[parallel] failed to create pipe.";
+      exit(1);
+    }
+    read_fds[k] = pipe_fds[0];
+    write_fds[k] = pipe_fds[1];
+  }
+
+  auto work = [&](unsigned worker_id) {
+    // a worker keeps only the write end of its own pipe.
+    for (unsigned j = 0; j < n_workers; ++j) {
+      close(read_fds[j]);
+      if (j != worker_id) { close(write_fds[j]); }
+    }
+    run_worker(filename, worker_id, n_workers, processor, write_fds[worker_id]);
+    close(write_fds[worker_id]);
+  };
+
+  auto supervise = [&]() {
+    for (unsigned k = 0; k < n_workers; ++k) { close(write_fds[k]); }
+    // lines are dealt out round-robin, so the first worker that runs out of
+    // output marks the end of the input.
+    std::string output;
+    for (unsigned idx = 0; ; ++idx) {
+      int fd = read_fds[idx % n_workers];
+      uint64_t size;
+      if (!read_all(fd, reinterpret_cast<char *>(&size), sizeof(size))) { break; }
+      output.resize(size);
+      if (size > 0 && !read_all(fd, &output[0], size)) { break; }
+      os << output;
+    }
+    os.flush();
+    for (unsigned k = 0; k < n_workers; ++k) { close(read_fds[k]); }
+  };
+
+  if (!fork_workers(n_workers, work, supervise)) { exit(1); }
+}
+
+void ParallelUtils::sum_counts(unsigned n_items,
+                               unsigned n_workers,
+                               unsigned n_counts,
+                               const ItemCounter & counter,
+                               std::vector<float> & counts) {
+  counts.assign(n_counts, 0.f);
+  if (n_workers <= 1 || n_items <= 1) {
+    for (unsigned idx = 0; idx < n_items; ++idx) { counter(idx, counts.data()); }
+    return;
+  }
+
+  size_t n_slots = static_cast<size_t>(n_workers) * n_counts;
+  float * slots = map_shared(n_slots);
+  bool succeeded = fork_workers(n_workers, [&](unsigned worker_id) {
+    float * slot = slots + worker_id * n_counts;
+    for (unsigned idx = worker_id; idx < n_items; idx += n_workers) { counter(idx, slot); }
+  });
+  if (!succeeded) { exit(1); }
+
+  for (unsigned k = 0; k < n_workers; ++k) {
+    for (unsigned i = 0; i < n_counts; ++i) { counts[i] += slots[k * n_counts + i]; }
+  }
+  unmap_shared(slots, n_slots);
+}
+
+namespace {
+
+void collect_tensors(dynet::ParameterCollection & model,
+                     std::vector<dynet::Tensor *> & tensors) {
+  const dynet::ParameterCollectionStorage & storage = model.get_storage();
+  for (auto & p : storage.params) { tensors.push_back(&(p->values)); }
+  for (auto & p : storage.lookup_params) { tensors.push_back(&(p->all_values)); }
+}
+
+}
+
+float ParallelUtils::mix_parameters(dynet::ParameterCollection & model,
+                                    unsigned n_workers,
+                                    const WorkerTrainer & work) {
+  BOOST_ASSERT_MSG(n_workers > 0, "[parallel] number of workers should be positive.");
+  std::vector<dynet::Tensor *> tensors;
+  collect_tensors(model, tensors);
+  size_t n_values = 0;
+  for (dynet::Tensor * tensor : tensors) { n_values += tensor->d.size(); }
+
+  // the slot of a worker holds its loss followed by its parameter values.
+  size_t slot_size = n_values + 1;
+  size_t n_slots = n_workers * slot_size;
+  float * slots = map_shared(n_slots);
+
+  // the forked workers share the random engine, so each is seeded apart.
+  unsigned seed = (*dynet::rndeng)();
+  bool succeeded = fork_workers(n_workers, [&](unsigned worker_id) {
+    dynet::rndeng->seed(seed + worker_id);
+    float * slot = slots + worker_id * slot_size;
+    slot[0] = work(worker_id);
+    float * values = slot + 1;
+    for (dynet::Tensor * tensor : tensors) {
+      std::vector<float> v = dynet::as_vector(*tensor);
+      std::memcpy(values, v.data(), v.size() * sizeof(float));
+      values += v.size();
+    }
+  });
+  if (!succeeded) { exit(1); }
+
+  float loss = 0.f;
+  for (unsigned k = 0; k < n_workers; ++k) { loss += slots[k * slot_size]; }
+  size_t offset = 1;
+  for (dynet::Tensor * tensor : tensors) {
+    std::vector<float> v(tensor->d.size(), 0.f);
+    for (unsigned k = 0; k < n_workers; ++k) {
+      const float * values = slots + k * slot_size + offset;
+      for (size_t i = 0; i < v.size(); ++i) { v[i] += values[i]; }
+    }
+    for (float & x : v) { x /= n_workers; }
+    dynet::TensorTools::set_elements(*tensor, v);
+    offset += v.size();
+  }
+  unmap_shared(slots, n_slots);
+  return loss;
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef __TWPIPE_PARALLEL_H__
+#define __TWPIPE_PARALLEL_H__
+
+#include <iostream>
+#include <functional>
+#include "dynet/model.h"
+
+namespace twpipe {
+
+typedef std::function<void(const std::string & line, std::ostream & os)> LineProcessor;
+
+typedef std::function<float(unsigned worker_id)> WorkerTrainer;
+
+typedef std::function<void(unsigned idx, float * counts)> ItemCounter;
+
+struct ParallelUtils {
+  /**
+   * Fork `n_workers` processes, the k-th of which runs `work(k)` and exits.
+   * `supervise`, if given, runs in this process while the workers run (e.g.
+   * to read their pipes). Return whether all the workers exited cleanly.
+   */
+  static bool fork_workers(unsigned n_workers,
+                           const std::function<void(unsigned worker_id)> & work,
+                           const std::function<void()> & supervise = nullptr);
+
+  /**
+   * Process the lines in the file with `n_workers` forked processes. The
+   * i-th line is handled by the (i % n_workers)-th worker, results are
+   * streamed back through pipes and written to `os` in the input order.
+   *
+   * Workers are processes instead of threads because dynet keeps its memory
+   * pools and computation graph globally. Models loaded before calling are
+   * shared copy-on-write.
+   */
+  static void process_lines(const std::string & filename,
+                            unsigned n_workers,
+                            const LineProcessor & processor,
+                            std::ostream & os);
+
+  /**
+   * One round of iterative parameter mixing. Each of the `n_workers` forked
+   * processes starts from the current values of `model`, runs `work` with
+   * its id (which is expected to train on its own shard of the data and
+   * return the loss) and leaves its parameter values in a shared mapping.
+   * The parent sets `model` to the average of the workers' values and
+   * returns the sum of their losses.
+   *
+   * Only the parameter values are mixed. Updates to other states of the
+   * workers (e.g. the moments of the optimizer) are dropped.
+   */
+  static float mix_parameters(dynet::ParameterCollection & model,
+                              unsigned n_workers,
+                              const WorkerTrainer & work);
+
+  /**
+   * Add up the `n_counts` counts of the items 0 to `n_items - 1` into
+   * `counts`. `counter` adds the counts of an item to the array it is given.
+   * The i-th item is handled by the (i % n_workers)-th forked worker, whose
+   * counts are left in a shared mapping. With a single worker, the items
+   * are counted in this process.
+   */
+  static void sum_counts(unsigned n_items,
+                         unsigned n_workers,
+                         unsigned n_counts,
+                         const ItemCounter & counter,
+                         std::vector<float> & counts);
+
+  /// Write exactly `n` bytes to `fd`, retrying on interruption.
+  static bool write_all(int fd, const char * data, size_t n);
+
+  /// Read exactly `n` bytes from `fd`, false on error or end-of-file.
+  static bool read_all(int fd, char * data, size_t n);
+};
+
+}
+
+#endif  //  end for __TWPIPE_PARALLEL_H__
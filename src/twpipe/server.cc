@@ -0,0 +1,261 @@
+#include "server.h"
+#include "logging.h"
+#include "json.hpp"
+#include <sstream>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <boost/assert.hpp>
+
+namespace twpipe {
+
+namespace {
+
+volatile sig_atomic_t stopping = 0;
+
+// a connection sending a longer line without a newline is closed.
+const size_t MAX_REQUEST_SIZE = 1 << 20;
+// a worker exiting within QUICK_EXIT_SECONDS of its spawn is respawned after
+// a growing delay, and the server gives up after MAX_QUICK_EXITS in a row.
+const time_t QUICK_EXIT_SECONDS = 5;
+const unsigned MAX_QUICK_EXITS = 5;
+
+void on_stop(int) { stopping = 1; }
+
+int listen_unix(const std::string & path) {
+  struct sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    _ERROR << "[server] socket path too long: " << path;
+    exit(1);
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    _ERROR << "[server] failed to create socket.";
+    exit(1);
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+    _ERROR << "[server] failed to bind " << path << ": " << strerror(errno);
+    exit(1);
+  }
+  return fd;
+}
+
+int listen_tcp(unsigned port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    _ERROR << "[server] failed to create socket.";
+    exit(1);
+  }
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+    _ERROR << "[server] failed to bind 127.0.0.1:" << port << ": " << strerror(errno);
+    exit(1);
+  }
+  return fd;
+}
+
+/// Get the text of a request line, false if it is malformed JSON.
+bool get_text(const std::string & line, std::string & text, std::string & error) {
+  size_t start = line.find_first_not_of(" \t\r");
+  if (start == std::string::npos || line[start] != '{') {
+    text = line;
+    return true;
+  }
+  try {
+    nlohmann::json request = nlohmann::json::parse(line.begin() + start, line.end());
+    auto it = request.find("text");
+    if (it == request.end() || !it->is_string()) {
+      error = "missing \"text\" field";
+      return false;
+    }
+    text = it->get<std::string>();
+  } catch (std::exception & e) {
+    error = e.what();
+    return false;
+  }
+  return true;
+}
+
+std::string respond(const std::string & line, const LineProcessor & processor) {
+  std::string text, error;
+  std::ostringstream oss;
+  if (get_text(line, text, error)) {
+    processor(text, oss);
+  } else {
+    oss << "# error = " << error << "\n";
+  }
+  std::string output = oss.str();
+  if (output.size() < 2 || output.compare(output.size() - 2, 2, "\n\n") != 0) {
+    output += "\n";
+  }
+  return output;
+}
+
+void handle_connection(int fd, const LineProcessor & processor) {
+  std::string pending;
+  char buffer[65536];
+  while (true) {
+    ssize_t ret = read(fd, buffer, sizeof(buffer));
+    if (ret < 0) {
+      if (errno == EINTR) { continue; }
+      return;
+    }
+    if (ret == 0) { break; }
+    pending.append(buffer, ret);
+
+    size_t begin = 0, end;
+    while ((end = pending.find('\n', begin)) != std::string::npos) {
+      std::string output = respond(pending.substr(begin, end - begin), processor);
+      begin = end + 1;
+      if (!ParallelUtils::write_all(fd, output.data(), output.size())) { return; }
+    }
+    pending.erase(0, begin);
+    if (pending.size() > MAX_REQUEST_SIZE) {
+      std::string output = "# error = request longer than " + std::to_string(MAX_REQUEST_SIZE) + " bytes\n\n";
+      ParallelUtils::write_all(fd, output.data(), output.size());
+      return;
+    }
+  }
+  // the last request may come without a trailing newline.
+  if (!pending.empty()) {
+    std::string output = respond(pending, processor);
+    ParallelUtils::write_all(fd, output.data(), output.size());
+  }
+}
+
+void run_worker(int listen_fd, const LineProcessor & processor) {
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) { continue; }
+      _exit(1);
+    }
+    handle_connection(fd, processor);
+    close(fd);
+  }
+}
+
+pid_t spawn_worker(int listen_fd, const LineProcessor & processor) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    _ERROR << "[server] failed to fork worker.";
+    exit(1);
+  }
+  if (pid == 0) {
+    run_worker(listen_fd, processor);
+    _exit(0);
+  }
+  return pid;
+}
+
+}
+
+po::options_description Server::get_options() {
+  po::options_description cmd("Server options");
+  cmd.add_options()
+    ("serve", "keep the models loaded and serve requests over a socket.")
+    ("serve-socket", po::value<std::string>(), "the path of the UNIX domain socket to serve on.")
+    ("serve-port", po::value<unsigned>()->default_value(8710), "the localhost TCP port to serve on if no socket is specified.")
+    ("serve-workers", po::value<unsigned>()->default_value(1), "the number of worker processes.")
+    ;
+  return cmd;
+}
+
+void Server::serve(const po::variables_map & conf, const LineProcessor & processor) {
+  unsigned n_workers = conf["serve-workers"].as<unsigned>();
+  BOOST_ASSERT_MSG(n_workers > 0, "[server] number of workers should be positive.");
+
+  std::string socket_path;
+  int listen_fd;
+  if (conf.count("serve-socket")) {
+    socket_path = conf["serve-socket"].as<std::string>();
+    listen_fd = listen_unix(socket_path);
+  } else {
+    listen_fd = listen_tcp(conf["serve-port"].as<unsigned>());
+  }
+  if (listen(listen_fd, SOMAXCONN) < 0) {
+    _ERROR << "[server] failed to listen: " << strerror(errno);
+    exit(1);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_stop;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  std::cout.flush();
+  std::vector<pid_t> pids(n_workers);
+  std::vector<time_t> spawned(n_workers);
+  std::vector<unsigned> n_quick_exits(n_workers, 0);
+  for (unsigned k = 0; k < n_workers; ++k) {
+    pids[k] = spawn_worker(listen_fd, processor);
+    spawned[k] = time(nullptr);
+  }
+  _INFO << "[server] serving on "
+        << (socket_path.empty() ? "127.0.0.1:" + std::to_string(conf["serve-port"].as<unsigned>()) : socket_path)
+        << " with " << n_workers << " workers.";
+
+  bool failed = false;
+  while (!stopping && !failed) {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) { continue; }
+      break;
+    }
+    for (unsigned k = 0; k < n_workers; ++k) {
+      if (pids[k] != pid) { continue; }
+      pids[k] = 0;
+      if (time(nullptr) - spawned[k] < QUICK_EXIT_SECONDS) {
+        n_quick_exits[k]++;
+      } else {
+        n_quick_exits[k] = 0;
+      }
+      if (n_quick_exits[k] >= MAX_QUICK_EXITS) {
+        _ERROR << "[server] worker #" << k << " exited " << n_quick_exits[k]
+               << " times right after spawning, giving up.";
+        failed = true;
+        break;
+      }
+      if (stopping) { break; }
+      _WARN << "[server] worker #" << k << " exited, respawning.";
+      // sleep is interrupted by SIGINT and SIGTERM.
+      if (n_quick_exits[k] > 0) { sleep(1u << n_quick_exits[k]); }
+      if (stopping) { break; }
+      pids[k] = spawn_worker(listen_fd, processor);
+      spawned[k] = time(nullptr);
+    }
+  }
+
+  _INFO << "[server] shutting down.";
+  // the reaped workers are marked by 0.
+  for (unsigned k = 0; k < n_workers; ++k) { if (pids[k] > 0) { kill(pids[k], SIGTERM); } }
+  for (unsigned k = 0; k < n_workers; ++k) { if (pids[k] > 0) { waitpid(pids[k], nullptr, 0); } }
+  close(listen_fd);
+  if (!socket_path.empty()) { unlink(socket_path.c_str()); }
+  if (failed) { exit(1); }
+}
+
+}
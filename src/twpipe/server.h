@@ -0,0 +1,32 @@
+#ifndef __TWPIPE_SERVER_H__
+#define __TWPIPE_SERVER_H__
+
+#include <string>
+#include <boost/program_options.hpp>
+#include "parallel.h"
+
+namespace po = boost::program_options;
+
+namespace twpipe {
+
+struct Server {
+  static po::options_description get_options();
+
+  /**
+   * Serve `processor` over a UNIX domain socket (--serve-socket) or a
+   * localhost TCP port (--serve-port) until SIGINT or SIGTERM.
+   *
+   * Each request is a line, either raw text or a JSON object like
+   * {"text": "..."}. Each response is the CoNLL-U output of the line and
+   * always ends with an empty line. The listening socket is shared by a
+   * pool of --serve-workers forked processes, each handling one connection
+   * at a time; dead workers are respawned, with a growing delay if they die
+   * right after spawning. A request line longer than 1MB closes the
+   * connection with an error.
+   */
+  static void serve(const po::variables_map & conf, const LineProcessor & processor);
+};
+
+}
+
+#endif  //  end for __TWPIPE_SERVER_H__
@@ -1,5 +1,8 @@
 #include "trainer.h"
+#include "logging.h"
+#include "dynet/dynet.h"
 #include <fstream>
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <boost/assert.hpp>
 
@@ -19,6 +22,9 @@ po::options_description Trainer::get_options() {
     ("max-iter", po::value<unsigned>()->default_value(100), "the maximum number of training.")
     ("evaluate-stops", po::value<unsigned>()->default_value(0), "perform early stopping.")
     ("evaluate-skips", po::value<unsigned>()->default_value(0), "skip the first n evaluation.")
+    ("batch-size", po::value<unsigned>()->default_value(1), "the number of sentences whose losses are summed for one update.")
+    ("evaluate-workers", po::value<unsigned>()->default_value(1), "the number of forked workers decoding the heldout data.")
+    ("bucket-size", po::value<unsigned>()->default_value(0), "the number of similar-length sentences in a shuffling bucket, 0 for a full shuffle.")
     ;
   return training_opts;
 }
@@ -28,6 +34,22 @@ Trainer::Trainer(const po::variables_map & conf) {
   evaluate_stops = conf["evaluate-stops"].as<unsigned>();
   evaluate_skips = conf["evaluate-skips"].as<unsigned>();
   lambda_ = conf["lambda"].as<float>();
+  batch_size = (conf.count("batch-size") ? conf["batch-size"].as<unsigned>() : 1);
+  if (batch_size == 0) { batch_size = 1; }
+  evaluate_workers = (conf.count("evaluate-workers") ? conf["evaluate-workers"].as<unsigned>() : 1);
+  bucket_size = (conf.count("bucket-size") ? conf["bucket-size"].as<unsigned>() : 0);
+  if (bucket_size % batch_size != 0) {
+    // so a full bucket splits into whole batches.
+    unsigned rounded = (bucket_size / batch_size + 1) * batch_size;
+    _WARN << "[train] bucket size " << bucket_size << " is not a multiple of batch size "
+          << batch_size << ", rounded up to " << rounded << ".";
+    bucket_size = rounded;
+  }
+  if (batch_size > 1 && !dynet::autobatch_flag) {
+    // the sentences of a batch share one graph, let dynet batch their operations.
+    dynet::autobatch_flag = 1;
+    _INFO << "[train] batch size = " << batch_size << ", dynet autobatching enabled.";
+  }
 }
 
 bool Trainer::need_evaluate(unsigned iter) {
@@ -38,4 +60,44 @@ bool Trainer::need_evaluate(unsigned iter, unsigned n_trained) {
   return ((iter > evaluate_skips) && evaluate_stops > 0 && (n_trained % evaluate_stops == 0));
 }
 
+bool Trainer::need_evaluate(unsigned iter, unsigned n_before, unsigned n_after) {
+  return ((iter > evaluate_skips) && evaluate_stops > 0 &&
+          (n_after / evaluate_stops > n_before / evaluate_stops));
+}
+
+void Trainer::shuffle(const Corpus & corpus, std::vector<unsigned> & order) {
+  bucket_ends.clear();
+  std::shuffle(order.begin(), order.end(), (*dynet::rndeng));
+  if (bucket_size == 0 || order.size() <= bucket_size) { return; }
+
+  // the shuffle above breaks the ties between sentences of the same length.
+  std::stable_sort(order.begin(), order.end(), [&corpus](unsigned a, unsigned b) {
+    return corpus.training_data[a].input_units.size() < corpus.training_data[b].input_units.size();
+  });
+  std::vector<unsigned> buckets;
+  for (unsigned begin = 0; begin < order.size(); begin += bucket_size) {
+    unsigned end = std::min<unsigned>(order.size(), begin + bucket_size);
+    std::shuffle(order.begin() + begin, order.begin() + end, (*dynet::rndeng));
+    buckets.push_back(begin);
+  }
+  std::shuffle(buckets.begin(), buckets.end(), (*dynet::rndeng));
+
+  std::vector<unsigned> sorted(order);
+  order.clear();
+  for (unsigned begin : buckets) {
+    unsigned end = std::min<unsigned>(sorted.size(), begin + bucket_size);
+    order.insert(order.end(), sorted.begin() + begin, sorted.begin() + end);
+    bucket_ends.push_back(order.size());
+  }
+}
+
+unsigned Trainer::next_batch_end(unsigned begin, unsigned n) const {
+  unsigned end = std::min(n, begin + batch_size);
+  // the partial bucket may land anywhere, so a batch is cut at the end of
+  // its bucket rather than spanning the next one.
+  auto bound = std::upper_bound(bucket_ends.begin(), bucket_ends.end(), begin);
+  if (bound != bucket_ends.end()) { end = std::min(end, *bound); }
+  return end;
+}
+
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #define __TWPIPE_TRAINER_H__
 
 #include <iostream>
+#include <vector>
 #include <boost/program_options.hpp>
+#include "corpus.h"
 
 namespace po = boost::program_options;
 
@@ -14,6 +16,10 @@ struct Trainer {
   unsigned evaluate_stops;
   unsigned evaluate_skips;
   float lambda_;
+  unsigned batch_size;
+  unsigned evaluate_workers;
+  unsigned bucket_size;
+  std::vector<unsigned> bucket_ends;  // the end of each bucket in the last shuffled order.
 
   static po::options_description get_options();
 
@@ -22,6 +28,21 @@ struct Trainer {
   bool need_evaluate(unsigned iter);
   
   bool need_evaluate(unsigned iter, unsigned n_trained);
+
+  /// Whether an evaluation stop is passed when a batch takes the number of
+  /// trained instances from n_before to n_after.
+  bool need_evaluate(unsigned iter, unsigned n_before, unsigned n_after);
+
+  /// Shuffle the ids of the training instances for a new iteration. With
+  /// a positive bucket_size (a multiple of batch_size), the ids are sorted
+  /// by the sentence length and cut into buckets of bucket_size, which are
+  /// shuffled inside and then among themselves, so each batch falls in one
+  /// bucket of similar lengths.
+  void shuffle(const Corpus & corpus, std::vector<unsigned> & order);
+
+  /// The end of the batch starting at begin in the shuffled order of n ids,
+  /// at most batch_size ids and never across the end of a bucket.
+  unsigned next_batch_end(unsigned begin, unsigned n) const;
 };
 
 }
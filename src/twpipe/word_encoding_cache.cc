@@ -0,0 +1,152 @@
+#include "word_encoding_cache.h"
+#include "alphabet_collection.h"
+#include "char_encoder.h"
+#include "embedding.h"
+#include "logging.h"
+#include <cstring>
+#include <algorithm>
+
+namespace twpipe {
+
+const size_t WordEncodingCache::kDefaultCapacity = 1 << 16;
+
+const unsigned WordEncodingCache::kFreezeBatchSize = 512;
+
+WordEncodingCache::WordEncodingCache() :
+  capacity(kDefaultCapacity),
+  enabled(false),
+  n_frozen(0),
+  frozen_dim(0) {
+}
+
+const std::vector<float> * WordEncodingCache::find(const std::string & word) {
+  auto found = index.find(word);
+  if (found == index.end()) { return nullptr; }
+  entries.splice(entries.begin(), entries, found->second);
+  return &(found->second->second);
+}
+
+void WordEncodingCache::insert(const std::string & word, std::vector<float> && value) {
+  if (capacity == 0) { return; }
+  auto found = index.find(word);
+  if (found != index.end()) {
+    found->second->second = std::move(value);
+    entries.splice(entries.begin(), entries, found->second);
+    return;
+  }
+  entries.emplace_front(word, std::move(value));
+  index[word] = entries.begin();
+  while (entries.size() > capacity) {
+    index.erase(entries.back().first);
+    entries.pop_back();
+  }
+}
+
+void WordEncodingCache::set_enabled(bool enabled) {
+  this->enabled = enabled;
+  clear();
+}
+
+void WordEncodingCache::clear() {
+  entries.clear();
+  index.clear();
+}
+
+void WordEncodingCache::render(dynet::ComputationGraph & cg,
+                               unsigned dim,
+                               const std::vector<std::string> & words,
+                               const Encoder & encode,
+                               std::vector<dynet::Expression> & encodings) {
+  unsigned n_words = words.size();
+  encodings.resize(n_words);
+
+  std::vector<bool> done(n_words, false);
+  if (n_frozen > 0) {
+    const Alphabet & word_map = AlphabetCollection::get()->word_map;
+    std::vector<const float *> rows;
+    std::vector<unsigned> positions;
+    for (unsigned i = 0; i < n_words; ++i) {
+      const float * row = find_frozen(word_map.find_or(words[i], Alphabet::kNone));
+      if (row == nullptr) { continue; }
+      rows.push_back(row);
+      positions.push_back(i);
+    }
+    std::vector<dynet::Expression> exprs;
+    WordEmbedding::input(cg, dim, rows, exprs);
+    for (unsigned k = 0; k < positions.size(); ++k) {
+      encodings[positions[k]] = exprs[k];
+      done[positions[k]] = true;
+    }
+  }
+
+  bool caching = (enabled && capacity > 0);
+  std::vector<unsigned> cids;
+  std::vector<unsigned> missed;
+  std::unordered_map<std::string, unsigned> built;
+  for (unsigned i = 0; i < n_words; ++i) {
+    if (done[i]) { continue; }
+    const std::string & word = words[i];
+    if (caching) {
+      const std::vector<float> * value = find(word);
+      if (value != nullptr) {
+        encodings[i] = dynet::input(cg, { dim }, *value);
+        continue;
+      }
+      auto found = built.find(word);
+      if (found != built.end()) {
+        encodings[i] = encodings[found->second];
+        continue;
+      }
+      built[word] = i;
+      missed.push_back(i);
+    }
+    cids.clear();
+    CharEncoder::get()->encode(word, cids);
+    encodings[i] = encode(cids);
+  }
+
+  if (missed.empty()) { return; }
+  // the missed words are forwarded together, so they can be autobatched.
+  std::vector<dynet::Expression> columns;
+  for (unsigned i : missed) { columns.push_back(encodings[i]); }
+  std::vector<float> values = dynet::as_vector(cg.incremental_forward(dynet::concatenate_cols(columns)));
+  for (unsigned k = 0; k < missed.size(); ++k) {
+    insert(words[missed[k]], std::vector<float>(values.begin() + k * dim,
+                                                values.begin() + (k + 1) * dim));
+  }
+}
+
+void WordEncodingCache::freeze(unsigned n_words,
+                               unsigned dim,
+                               const std::function<void(dynet::ComputationGraph &)> & new_graph,
+                               const Encoder & encode) {
+  const Alphabet & word_map = AlphabetCollection::get()->word_map;
+  n_words = std::min(n_words, word_map.size());
+  n_frozen = 0;
+  frozen_dim = dim;
+  frozen.assign(static_cast<size_t>(n_words) * dim, 0.f);
+  if (n_words == 0 || dim == 0) { return; }
+
+  // word ids are assigned by the first occurrence in the training data, so
+  // the first ones are roughly the most frequent ones.
+  std::vector<unsigned> cids;
+  for (unsigned begin = 0; begin < n_words; begin += kFreezeBatchSize) {
+    unsigned end = std::min(n_words, begin + kFreezeBatchSize);
+    dynet::ComputationGraph cg;
+    new_graph(cg);
+    std::vector<dynet::Expression> exprs;
+    for (unsigned wid = begin; wid < end; ++wid) {
+      cids.clear();
+      if (word_map.contains(wid)) { CharEncoder::get()->encode(word_map.get_ref(wid), cids); }
+      exprs.push_back(encode(cids));
+    }
+    // column j of the dim x n matrix is the encoding of word (begin + j).
+    std::vector<float> values = dynet::as_vector(cg.forward(dynet::concatenate_cols(exprs)));
+    std::memcpy(frozen.data() + static_cast<size_t>(begin) * dim, values.data(),
+                values.size() * sizeof(float));
+  }
+  n_frozen = n_words;
+  _INFO << "[encoding] froze the encodings of " << n_frozen << " words.";
+}
+
+}
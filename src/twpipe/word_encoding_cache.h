@@ -0,0 +1,83 @@
+#ifndef __TWPIPE_WORD_ENCODING_CACHE_H__
+#define __TWPIPE_WORD_ENCODING_CACHE_H__
+
+#include <list>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include "dynet/expr.h"
+
+namespace twpipe {
+
+/**
+ * The values of per-word encodings (e.g. the final states of the char-rnn).
+ * The encoding of a word only depends on the word and the parameters, so
+ * the values are only valid while the parameters are fixed.
+ *
+ * The first words of the word alphabet can be frozen into a dense table,
+ * one row per word id, when a model is loaded for testing. The other words
+ * go to a least-recently-used cache, which should be cleared once the
+ * parameters are updated.
+ */
+struct WordEncodingCache {
+  typedef std::pair<std::string, std::vector<float>> Entry;
+  typedef std::function<dynet::Expression(const std::vector<unsigned> &)> Encoder;
+
+  static const size_t kDefaultCapacity;
+  static const unsigned kFreezeBatchSize;
+
+  size_t capacity;
+  bool enabled;
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+  unsigned n_frozen;
+  unsigned frozen_dim;
+  std::vector<float> frozen;
+
+  WordEncodingCache();
+
+  /// The cached value of the word, or nullptr. The word becomes the most
+  /// recently used one.
+  const std::vector<float> * find(const std::string & word);
+
+  /// Cache the value of the word, evicting the least recently used words
+  /// beyond the capacity.
+  void insert(const std::string & word, std::vector<float> && value);
+
+  /// Enable or disable the cache. The cached values are dropped either way,
+  /// the frozen ones are kept.
+  void set_enabled(bool enabled);
+
+  void clear();
+
+  size_t size() const { return entries.size(); }
+
+  /// The frozen value of the word id, or nullptr.
+  const float * find_frozen(unsigned wid) const {
+    return (wid < n_frozen ? frozen.data() + static_cast<size_t>(wid) * frozen_dim : nullptr);
+  }
+
+  /// The encodings of the words as expressions of the graph. The frozen ones
+  /// are fed as a single input, and when the cache is enabled, so are the
+  /// cached ones. The others are built by encode from the char ids. If the
+  /// cache is enabled, they are forwarded together at the end and cached.
+  void render(dynet::ComputationGraph & cg,
+              unsigned dim,
+              const std::vector<std::string> & words,
+              const Encoder & encode,
+              std::vector<dynet::Expression> & encodings);
+
+  /// Compute the dim-dimension encodings of the first n_words words of the
+  /// word alphabet by encode and store them as a dense table. A new graph
+  /// is prepared by new_graph for every batch of words.
+  void freeze(unsigned n_words,
+              unsigned dim,
+              const std::function<void(dynet::ComputationGraph &)> & new_graph,
+              const Encoder & encode);
+};
+
+}
+
+#endif  //  end for __TWPIPE_WORD_ENCODING_CACHE_H__